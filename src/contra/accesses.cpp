@@ -0,0 +1,56 @@
+#include "accesses.hpp"
+
+namespace contra {
+
+//==============================================================================
+void AccessIdentifier::runVisitor(FunctionAST&e)
+{
+  // tasks that launch other tasks keep full access
+  if (!e.isTask() || !e.isLeaf()) return;
+
+  Accesses_.clear();
+  e.accept(*this);
+  e.setFieldAccesses(Accesses_);
+}
+
+//==============================================================================
+void AccessIdentifier::addAccess(VariableDef* VarDef, FieldAccess Access)
+{
+  if (!VarDef || !VarDef->isField()) return;
+  auto & Existing = Accesses_[VarDef->getName()];
+  Existing = Existing | Access;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Vizitors
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+void AccessIdentifier::postVisit(VarAccessExprAST& e)
+{
+  // the whole field escapes, so assume anything can happen to it
+  addAccess(e.getVariableDef(), FieldAccess::ReadWrite);
+}
+
+//==============================================================================
+void AccessIdentifier::postVisit(ArrayAccessExprAST& e)
+{ addAccess(e.getVariableDef(), FieldAccess::Read); }
+
+//==============================================================================
+void AccessIdentifier::visit(AssignStmtAST& e)
+{
+  for (const auto & Left : e.getLeftExprs()) {
+    auto LeftExpr = dynamic_cast<ArrayAccessExprAST*>(Left.get());
+    if (LeftExpr && LeftExpr->getVariableDef()->isField()) {
+      LeftExpr->getIndexExpr()->accept(*this);
+      addAccess(LeftExpr->getVariableDef(), FieldAccess::Write);
+    }
+    else {
+      Left->accept(*this);
+    }
+  }
+  for (const auto & Right : e.getRightExprs())
+    Right->accept(*this);
+}
+
+} // namespace
@@ -0,0 +1,33 @@
+#ifndef CONTRA_ACCESSES_HPP
+#define CONTRA_ACCESSES_HPP
+
+#include "accessinfo.hpp"
+#include "config.hpp"
+#include "recursive.hpp"
+
+#include <map>
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Field access identifier
+////////////////////////////////////////////////////////////////////////////////
+class AccessIdentifier : public RecursiveAstVisiter {
+
+  std::map<std::string, FieldAccess> Accesses_;
+
+  void addAccess(VariableDef* VarDef, FieldAccess Access);
+  
+public:
+
+  void runVisitor(FunctionAST&e);
+  
+  void postVisit(VarAccessExprAST& e) override;
+  void postVisit(ArrayAccessExprAST& e) override;
+  void visit(AssignStmtAST& e) override;
+
+};
+
+} // namespace
+
+#endif // CONTRA_ACCESSES_HPP
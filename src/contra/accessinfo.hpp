@@ -0,0 +1,30 @@
+#ifndef CONTRA_ACCESSINFO_HPP
+#define CONTRA_ACCESSINFO_HPP
+
+namespace contra {
+
+//==============================================================================
+// How a task touches a field
+//==============================================================================
+enum class FieldAccess : unsigned char {
+  None = 0,
+  Read = 1,
+  Write = 2,
+  ReadWrite = 3
+};
+
+inline FieldAccess operator|(FieldAccess A, FieldAccess B)
+{
+  return static_cast<FieldAccess>(
+      static_cast<unsigned char>(A) | static_cast<unsigned char>(B));
+}
+
+inline bool isRead(FieldAccess A)
+{ return (static_cast<unsigned char>(A) & 1); }
+
+inline bool isWrite(FieldAccess A)
+{ return (static_cast<unsigned char>(A) & 2); }
+
+} // namespace
+
+#endif // CONTRA_ACCESSINFO_HPP
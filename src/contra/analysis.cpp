@@ -19,11 +19,14 @@ Analyzer::Analyzer(std::shared_ptr<BinopPrecedence> Prec) :
 
   std::vector< std::tuple<std::string, VariableType, std::vector<VariableType>> >
     fun = {
+      {I32Type_.getBaseType()->getName(), I32Type_, {F64Type_}},
       {I64Type_.getBaseType()->getName(), I64Type_, {F64Type_}},
+      {F32Type_.getBaseType()->getName(), F32Type_, {I64Type_}},
       {F64Type_.getBaseType()->getName(), F64Type_, {I64Type_}},
       {"len", I64Type_, {RangeType_}},
       {"part", setPartition(I64Type_), {RangeType_, setArray(I64Type_)}},
       {"part", setPartition(I64Type_), {RangeType_, setPartition(I64Type_), setField(I64Type_)}},
+      {"blocks", setPartition(I64Type_), {RangeType_, setArray(I64Type_), setArray(I64Type_)}},
     };
 
   for (const auto & f : fun) {
@@ -222,10 +225,15 @@ Analyzer::promote(
   if (LeftType == RightType) return LeftType;
 
   if (LeftType.isNumber() && RightType.isNumber()) {
-    if (LeftType == F64Type_ || RightType == F64Type_)
-      return F64Type_;
-    else
-      return LeftType;
+    // reals win over integers, then the wider type wins
+    auto Rank = [&](const VariableType & Ty) {
+      auto BaseT = Ty.getBaseType();
+      if (BaseT == F64Type_.getBaseType()) return 3;
+      if (BaseT == F32Type_.getBaseType()) return 2;
+      if (BaseT == I64Type_.getBaseType()) return 1;
+      return 0;
+    };
+    return Rank(LeftType) >= Rank(RightType) ? LeftType : RightType;
   }
   
   THROW_NAME_ERROR("No promotion rules between the type '" << LeftType
@@ -234,6 +242,31 @@ Analyzer::promote(
   return {};
 }
 
+//==============================================================================
+// Can this literal take on the given type without widening it
+//==============================================================================
+bool Analyzer::isLiteralFor(NodeAST* Expr, const VariableType & Ty) const
+{
+  if (auto UnaryExpr = dynamic_cast<UnaryExprAST*>(Expr))
+    Expr = UnaryExpr->getOpExpr();
+  
+  auto ValueExpr = dynamic_cast<ValueExprAST*>(Expr);
+  if (!ValueExpr || !Ty.isNumber()) return false;
+
+  auto BaseT = Ty.getBaseType();
+  auto IsReal =
+    (BaseT == F32Type_.getBaseType() || BaseT == F64Type_.getBaseType());
+
+  switch (ValueExpr->getValueType()) {
+  case ValueExprAST::ValueType::Int:
+    return true;
+  case ValueExprAST::ValueType::Real:
+    return IsReal;
+  default:
+    return false;
+  }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Visitors
 ////////////////////////////////////////////////////////////////////////////////
@@ -285,6 +318,9 @@ void Analyzer::visit(ArrayAccessExprAST& e)
   if (IndexType.isRange()) {
     VarType.setField();
   }
+  else if (IndexType == I32Type_) {
+    e.setIndexExpr( insertCastOp(e.moveIndexExpr(), I64Type_) );
+  }
   else if (IndexType != I64Type_)
     THROW_NAME_ERROR( "Array index for variable '" << Name << "' must "
         << "evaluate to an integer.", Loc );
@@ -433,7 +469,13 @@ void Analyzer::visit(BinaryExprAST& e)
   if (RightType != LeftType) {
     checkIsCastable(RightType, LeftType, RightLoc);
     checkIsCastable(LeftType, RightType, LeftLoc);
-    CommonType = promote(LeftType, RightType, Loc);
+    // literals take on the precision of the other operand
+    if (isLiteralFor(e.getRightExpr(), LeftType))
+      CommonType = LeftType;
+    else if (isLiteralFor(e.getLeftExpr(), RightType))
+      CommonType = RightType;
+    else
+      CommonType = promote(LeftType, RightType, Loc);
     if (RightType != CommonType)
       e.setRightExpr( insertCastOp(e.moveRightExpr(), CommonType ) );
     else
@@ -478,6 +520,9 @@ void Analyzer::visit(CallExprAST& e)
   int NumFixedArgs = FunRes->getNumArgs();
 
   auto IsTask = FunRes->isTask();
+  
+  // casts convert any number directly
+  auto IsCast = static_cast<bool>(Context::instance().getType(FunName));
 
   if (IsTask && isGlobalScope()) {
     if (HaveTopLevelTask_)  
@@ -511,7 +556,8 @@ void Analyzer::visit(CallExprAST& e)
 
     if (i<NumFixedArgs) {
       auto ParamType = FunRes->getArgType(i);
-      if (ArgType != ParamType) {
+      auto IsDirectCast = IsCast && ArgType.isNumber();
+      if (!IsDirectCast && ArgType != ParamType) {
         checkIsCastable(ArgType, ParamType, ArgExpr->getLoc());
         e.setArgExpr(i, insertCastOp( e.moveArgExpr(i), ParamType) );
       }
@@ -558,6 +604,7 @@ void Analyzer::visit(ForStmtAST& e)
   auto VarId = e.getVarId();
   insertVariable(VarId, I64Type_);
   for ( const auto & stmt : e.getBodyExprs() ) runStmtVisitor(*stmt);
+  e.setAccessedVariables( Context::instance().getVariablesAccessedFromAbove() );
   popScope();
   
   TypeResult_ = VoidType_;
@@ -643,7 +690,7 @@ void Analyzer::visit(BreakStmtAST&)
 void Analyzer::visit(IfStmtAST& e)
 {
   auto CondType = runExprVisitor(*e.getCondExpr());
-  if (CondType != BoolType_ && CondType != I64Type_)
+  if (CondType != BoolType_ && CondType != I64Type_ && CondType != I32Type_)
     THROW_NAME_ERROR(
         "If condition must result in boolean or integer type.",
         e.getCondExpr()->getLoc() );
@@ -777,20 +824,33 @@ void Analyzer::visit(PartitionStmtAST& e)
 void Analyzer::visit(ReductionStmtAST& e)
 {
   auto NumVars = e.getNumVars();
+  bool HasElements = false;
 
   for (unsigned i=0; i<NumVars; ++i) {
     const auto & VarId = e.getVarId(i);
     auto VarDef = getVariable(VarId);
     const auto VarType = VarDef->getType();
-    if (VarType != strip(VarType))
+    if (VarType.isField() || VarType.isArray())
+      HasElements = true;
+    else if (VarType != strip(VarType))
       THROW_NAME_ERROR(
-          "Reductions currently only supported for scalars.",
+          "Reductions currently only supported for scalars, arrays and fields.",
           VarId.getLoc());
     e.setVarDef(i, VarDef);
   }
 
   auto OpLoc = e.getOperatorLoc();
 
+  // field and array entries are combined by the runtime
+  if (HasElements) {
+    auto Op = SupportedReductions::getType(e.getOperatorName());
+    if (Op != ReductionType::Add && Op != ReductionType::Mult &&
+        Op != ReductionType::Min && Op != ReductionType::Max)
+      THROW_NAME_ERROR(
+          "Field and array reductions only support '+', '*', 'min' and 'max'.",
+          OpLoc);
+  }
+
   //------------------------------------
   // builtin operators
   if (e.isOperator()) {
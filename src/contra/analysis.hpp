@@ -27,7 +27,9 @@ private:
 
   std::shared_ptr<BinopPrecedence> BinopPrecedence_;
 
+  VariableType I32Type_  = VariableType(Context::instance().getInt32Type());
   VariableType I64Type_  = VariableType(Context::instance().getInt64Type());
+  VariableType F32Type_  = VariableType(Context::instance().getFloat32Type());
   VariableType F64Type_  = VariableType(Context::instance().getFloat64Type());
   VariableType StrType_  = VariableType(Context::instance().getStringType());
   VariableType BoolType_ = VariableType(Context::instance().getBoolType());
@@ -155,6 +157,8 @@ private:
       const VariableType & LeftType,
       const VariableType & RightType,
       const LocationRange & Loc);
+
+  bool isLiteralFor(NodeAST*, const VariableType &) const;
   
 
   // Scope interface
@@ -2,6 +2,7 @@
 #define CONTRA_AST_HPP
 
 #include "visiter.hpp"
+#include "accessinfo.hpp"
 #include "config.hpp"
 #include "errors.hpp"
 #include "identifier.hpp"
@@ -159,6 +160,7 @@ protected:
   Identifier Id_;
   std::unique_ptr<Identifier> TypeId_;
   VariableDef* VarDef_ = nullptr;
+  bool IsLastUse_ = false;
 
   // Note: Derived member VarType_ might differ from VarDef->getType().
   // This is because the accessed type might be different from the original
@@ -186,6 +188,9 @@ public:
   void setVariableDef(VariableDef* VarDef) { VarDef_=VarDef; }
   VariableDef* getVariableDef() const { return VarDef_; }
 
+  void setLastUse(bool IsLastUse=true) { IsLastUse_ = IsLastUse; }
+  auto isLastUse() const { return IsLastUse_; }
+
   auto hasTypeId() const { return static_cast<bool>(TypeId_); }
   const auto & getTypeId() const { return *TypeId_; }
 };
@@ -214,6 +219,8 @@ public:
   { return "VarAccessExprAST"; };
   
   auto getIndexExpr() const { return IndexExpr_.get(); }
+  auto moveIndexExpr() { return std::move(IndexExpr_); }
+  auto setIndexExpr(std::unique_ptr<NodeAST> Expr) { IndexExpr_ = std::move(Expr); }
 
 };
 
@@ -226,6 +233,8 @@ protected:
   ASTBlock ValExprs_;
   std::unique_ptr<NodeAST> SizeExpr_;
   std::string Name_;
+  bool IsStack_ = false;
+  bool IsTaskLocal_ = false;
 
 public:
 
@@ -250,6 +259,12 @@ public:
   void setName(const std::string & Name) { Name_ = Name; }
   const auto & getName() const { return Name_; }
 
+  void setStack(bool IsStack=true) { IsStack_ = IsStack; }
+  auto isStack() const { return IsStack_; }
+
+  void setTaskLocal(bool IsTaskLocal=true) { IsTaskLocal_ = IsTaskLocal; }
+  auto isTaskLocal() const { return IsTaskLocal_; }
+
   bool hasSize() const { return static_cast<bool>(SizeExpr_); }
   auto getSizeExpr() const { return SizeExpr_.get(); }
 
@@ -452,6 +467,7 @@ protected:
   Identifier CalleeId_;
   ASTBlock ArgExprs_;
   bool IsTopTask_ = false;
+  bool IsInlined_ = false;
   std::vector<VariableType> ArgTypes_;
   
   FunctionDef* FunctionDef_ = nullptr;
@@ -476,6 +492,9 @@ public:
   void setTopLevelTask(bool TopTask = true) { IsTopTask_ = TopTask; }
   bool isTopLevelTask() { return IsTopTask_; }
   
+  void setInlined(bool IsInlined = true) { IsInlined_ = IsInlined; }
+  bool isInlined() const { return IsInlined_; }
+  
   virtual void accept(AstVisiter& visiter) override;
   
   virtual std::string getClassName() const override
@@ -566,6 +585,17 @@ public:
   auto getCondExpr() const { return CondExpr_.get(); }
   const auto & getThenExprs() const { return ThenExpr_; }
   const auto & getElseExprs() const { return ElseExpr_; }
+
+  auto moveThenExpr(unsigned i) { return std::move(ThenExpr_[i]); }
+  auto setThenExpr(unsigned i, std::unique_ptr<NodeAST> Expr)
+  { ThenExpr_[i] = std::move(Expr); }
+  
+  auto moveElseExpr(unsigned i) { return std::move(ElseExpr_[i]); }
+  auto setElseExpr(unsigned i, std::unique_ptr<NodeAST> Expr)
+  { ElseExpr_[i] = std::move(Expr); }
+
+  void eraseThenExpr(unsigned i) { ThenExpr_.erase(ThenExpr_.begin()+i); }
+  void eraseElseExpr(unsigned i) { ElseExpr_.erase(ElseExpr_.begin()+i); }
 };
 
 //==============================================================================
@@ -578,6 +608,8 @@ protected:
   Identifier VarId_;
   std::unique_ptr<NodeAST> StartExpr_;
   ASTBlock BodyExprs_;
+  bool IsTraceable_ = false;
+  std::vector<VariableDef*> AccessedVariables_;
 
 public:
 
@@ -601,8 +633,27 @@ public:
   const auto & getVarId() const { return VarId_; }
 
   const auto & getBodyExprs() const { return BodyExprs_; }
+  
+  auto moveBodyExpr(unsigned i) { return std::move(BodyExprs_[i]); }
+  auto setBodyExpr(unsigned i, std::unique_ptr<NodeAST> Expr)
+  { BodyExprs_[i] = std::move(Expr); }
+  
+  void insertBodyExpr(unsigned i, std::unique_ptr<NodeAST> Expr)
+  { BodyExprs_.emplace(BodyExprs_.begin()+i, std::move(Expr)); }
+  void eraseBodyExpr(unsigned i) { BodyExprs_.erase(BodyExprs_.begin()+i); }
 
   auto getStartExpr() const { return StartExpr_.get(); }
+  auto moveStartExpr() { return std::move(StartExpr_); }
+  auto setStartExpr(std::unique_ptr<NodeAST> Expr) { StartExpr_ = std::move(Expr); }
+
+  bool isTraceable() const { return IsTraceable_; }
+  void setTraceable(bool IsTraceable=true) { IsTraceable_ = IsTraceable; }
+
+  void setAccessedVariables(const std::vector<VariableDef*> & VarDefs)
+  { AccessedVariables_ = VarDefs; }
+
+  const auto & getAccessedVariables()
+  { return AccessedVariables_; }
 };
 
 //==============================================================================
@@ -610,12 +661,12 @@ public:
 //==============================================================================
 class ForeachStmtAST : public ForStmtAST {
 
-  std::vector<VariableDef*> AccessedVariables_;
   std::string Name_;
   bool IsLifted_ = false;
   unsigned NumQualifiers_ = 0;
   
   bool HasReduce_ = false;
+  bool IsAccumulate_ = false;
   std::vector<ReductionDef> ReduceVariables_;
 
 
@@ -636,12 +687,6 @@ public:
   
   virtual void accept(AstVisiter& visiter) override;
 
-  void setAccessedVariables(const std::vector<VariableDef*> & VarDefs)
-  { AccessedVariables_ = VarDefs; }
-
-  const auto & getAccessedVariables()
-  { return AccessedVariables_; }
-
   auto getBodyExpr(unsigned i) const { return BodyExprs_[i].get(); }
 
   auto moveBodyExprs() {
@@ -666,6 +711,10 @@ public:
   void setHasReduction(bool HasReduce=true) { HasReduce_=HasReduce; }
   bool hasReduction() const { return HasReduce_; }
 
+  // reduction results are combined with, not stored over, the old values
+  void setAccumulate(bool IsAccumulate=true) { IsAccumulate_=IsAccumulate; }
+  bool isAccumulate() const { return IsAccumulate_; }
+
   const auto & getReductionVars() const { return ReduceVariables_; }
   void setReductionVars(const std::vector<ReductionDef> & ReduceVars)
   { ReduceVariables_ = ReduceVars; }
@@ -942,6 +991,11 @@ protected:
   std::string Name_;
   bool IsLeaf_ = false;
 
+  bool HasFieldAccesses_ = false;
+  std::map<std::string, FieldAccess> FieldAccesses_;
+
+  std::map<const NodeAST*, std::vector<std::string>> Releases_;
+
   FunctionDef* FunctionDef_ = nullptr;
 
 public:
@@ -1008,12 +1062,42 @@ public:
   
   auto getNumBodyExprs() const { return BodyExprs_.size(); }
   const auto & getBodyExprs() const { return BodyExprs_; }
+  
+  auto moveBodyExpr(unsigned i) { return std::move(BodyExprs_[i]); }
+  auto setBodyExpr(unsigned i, std::unique_ptr<NodeAST> Expr)
+  { BodyExprs_[i] = std::move(Expr); }
+  void eraseBodyExpr(unsigned i) { BodyExprs_.erase(BodyExprs_.begin()+i); }
 
   auto getFunctionDef() const { return FunctionDef_; }
   void setFunctionDef(FunctionDef* F) { FunctionDef_ = F; }
 
   void setLeaf(bool IsLeaf = true) { IsLeaf_ = IsLeaf; }
   bool isLeaf() const { return IsLeaf_; }
+
+  void setFieldAccesses(const std::map<std::string, FieldAccess> & Accesses)
+  {
+    FieldAccesses_ = Accesses;
+    HasFieldAccesses_ = true;
+  }
+
+  // fields are assumed to be read and written unless shown otherwise
+  FieldAccess getFieldAccess(const std::string & Name) const
+  {
+    if (!HasFieldAccesses_) return FieldAccess::ReadWrite;
+    auto it = FieldAccesses_.find(Name);
+    return it != FieldAccesses_.end() ? it->second : FieldAccess::None;
+  }
+
+  // variables that can be freed right after a body statement
+  void addRelease(const NodeAST* Stmt, const std::string & Name)
+  { Releases_[Stmt].emplace_back(Name); }
+
+  std::vector<std::string> getReleases(const NodeAST* Stmt) const
+  {
+    auto it = Releases_.find(Stmt);
+    if (it == Releases_.end()) return {};
+    return it->second;
+  }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1049,6 +1133,7 @@ class IndexTaskAST : public FunctionAST {
   std::string LoopVarName_;
   std::vector<VariableDef*> Vars_;
   std::vector<ReductionDef> ReductionVars_;
+  std::vector<ReductionDef> ArgReductionVars_;
 
 public:
 
@@ -1057,11 +1142,13 @@ public:
       ASTBlock Body,
       const std::string & LoopVar,
       const std::vector<VariableDef*>& Vars,
-      const std::vector<ReductionDef>& ReduceVars = {}) :
+      const std::vector<ReductionDef>& ReduceVars = {},
+      const std::vector<ReductionDef>& ArgReduceVars = {}) :
     FunctionAST(Name, std::move(Body), true, false),
     LoopVarName_(LoopVar),
     Vars_(Vars),
-    ReductionVars_(ReduceVars)
+    ReductionVars_(ReduceVars),
+    ArgReductionVars_(ArgReduceVars)
   {}
 
   virtual void accept(AstVisiter& visiter) override;
@@ -1075,6 +1162,9 @@ public:
   bool hasReduction() { return !ReductionVars_.empty(); }
   const auto & getReductionDefs() { return ReductionVars_; }
 
+  bool hasArgReduction() { return !ArgReductionVars_.empty(); }
+  const auto & getArgReductionDefs() { return ArgReductionVars_; }
+
   const auto & getLoopVariableName() const { return LoopVarName_; }
   const auto & getName() const { return Name_; }
 };
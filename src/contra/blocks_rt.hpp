@@ -0,0 +1,103 @@
+#ifndef CONTRA_BLOCKS_RT_HPP
+#define CONTRA_BLOCKS_RT_HPP
+
+#include "config.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Block partitions of a row-major, multi-dimensional index space.
+///
+/// Each dimension is split into the given number of nearly equal chunks, and
+/// the parts are numbered with the last dimension varying fastest.  The
+/// indices of every part are stored contiguously, with part p spanning
+/// [offsets[p], offsets[p+1]).
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+inline void blockPartition(
+    const int_t * dims,
+    int_t num_dims,
+    const int_t * blocks,
+    int_t num_blocks,
+    int_t is_size,
+    int_t & num_parts,
+    int_t *& indices,
+    int_t *& offsets)
+{
+  if (num_blocks != num_dims) {
+    std::cerr << "Block partitions need as many block counts as dimensions."
+      << std::endl;
+    abort();
+  }
+
+  int_t index_size = 1;
+  num_parts = 1;
+  for (int_t d=0; d<num_dims; ++d) {
+    if (dims[d] < 0) {
+      std::cerr << "Block partitions can not have negative dimensions."
+        << std::endl;
+      abort();
+    }
+    if (blocks[d] <= 0) {
+      std::cerr << "Block partitions need at least one block per dimension."
+        << std::endl;
+      abort();
+    }
+    index_size *= dims[d];
+    num_parts *= blocks[d];
+  }
+
+  if (index_size != is_size) {
+    std::cerr << "Index spaces partitioned by blocks MUST match the size of "
+      << "the original index space." << std::endl;
+    abort();
+  }
+
+  indices = new int_t[index_size];
+  offsets = new int_t[num_parts+1];
+  offsets[0] = 0;
+
+  std::vector<int_t> lo(num_dims), hi(num_dims), pt(num_dims);
+
+  for (int_t p=0, cnt=0; p<num_parts; ++p) {
+
+    // block bounds, the last dimension varies fastest
+    bool is_empty = false;
+    for (int_t d=num_dims-1, r=p; d>=0; --d) {
+      auto b = r % blocks[d];
+      r /= blocks[d];
+      auto chunk_size = dims[d] / blocks[d];
+      auto remainder = dims[d] % blocks[d];
+      lo[d] = b*chunk_size + std::min(b, remainder);
+      hi[d] = lo[d] + chunk_size + (b<remainder ? 1 : 0);
+      if (lo[d] == hi[d]) is_empty = true;
+    }
+
+    // points of the block in row-major order
+    pt = lo;
+    while (!is_empty) {
+      int_t index = 0;
+      for (int_t d=0; d<num_dims; ++d) index = index*dims[d] + pt[d];
+      indices[cnt++] = index;
+
+      int_t d = num_dims-1;
+      for (; d>=0; --d) {
+        if (++pt[d] < hi[d]) break;
+        pt[d] = lo[d];
+      }
+      if (d<0) break;
+    }
+
+    offsets[p+1] = cnt;
+  }
+}
+
+} // namespace
+
+#endif // CONTRA_BLOCKS_RT_HPP
@@ -30,6 +30,8 @@
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Transforms/Scalar/GVN.h"
 
+#include <algorithm>
+
 using namespace llvm;
 using namespace utils;
 
@@ -54,7 +56,9 @@ CodeGen::CodeGen (
   librt::RunTimeLib::setup(TheContext_);
   
   // setup types
+  I32Type_  = llvmType<std::int32_t>(TheContext_);
   I64Type_  = llvmType<int_t>(TheContext_);
+  F32Type_  = llvmType<float>(TheContext_);
   F64Type_  = llvmType<real_t>(TheContext_);
   VoidType_ = Type::getVoidTy(TheContext_);
   ArrayType_ = librt::DopeVector::DopeVectorType;
@@ -109,7 +113,9 @@ CodeGen::CodeGen (
 
   // setup types
   auto & C = Context::instance();
+  TypeTable_.emplace( C.getInt32Type()->getName(),  I32Type_);
   TypeTable_.emplace( C.getInt64Type()->getName(),  I64Type_);
+  TypeTable_.emplace( C.getFloat32Type()->getName(),  F32Type_);
   TypeTable_.emplace( C.getFloat64Type()->getName(),  F64Type_);
   TypeTable_.emplace( C.getVoidType()->getName(), VoidType_);
 
@@ -205,6 +211,10 @@ void CodeGen::popScope()
   std::vector<Value*> Accessors;
   std::vector<Value*> Partitions;
 
+  // reductions into outer variables can keep running
+  for ( const auto & entry_pair : VariableTable_.front() )
+    resolveReduction(entry_pair.second.getAlloca());
+
   for ( const auto & entry_pair : VariableTable_.front() ) {
     auto VarE = entry_pair.second;
     destroyVariable(VarE);
@@ -252,7 +262,10 @@ VariableAlloca * CodeGen::getVariable(const std::string & VarName)
 { 
   for ( auto & ST : VariableTable_ ) {
     auto it = ST.find(VarName);
-    if (it != ST.end()) return &it->second;
+    if (it != ST.end()) {
+      resolveReduction(it->second.getAlloca());
+      return &it->second;
+    }
   }
   return nullptr;
 }
@@ -280,7 +293,10 @@ std::pair<VariableAlloca*, bool> CodeGen::getOrCreateVariable(
 {
   for ( auto & ST : VariableTable_ ) {
     auto it = ST.find(VarName);
-    if (it != ST.end()) return {&it->second, false};
+    if (it != ST.end()) {
+      resolveReduction(it->second.getAlloca());
+      return {&it->second, false};
+    }
   }
 
   AllocaInst* NewVar = nullptr;
@@ -323,6 +339,47 @@ VariableAlloca * CodeGen::insertVariable(
   return insertVariable(VarName, VarE);
 }
 
+//==============================================================================
+// Defer waiting on a reduction
+//==============================================================================
+void CodeGen::deferReduction(
+    Value* FutureV,
+    Type* ResultT,
+    const std::vector<Value*> & ReduceAs)
+{ PendingReductions_.emplace_back( PendingReduction{FutureV, ResultT, ReduceAs} ); }
+
+//==============================================================================
+// Wait on any reductions that target a variable
+//==============================================================================
+void CodeGen::resolveReduction(Value* VarA)
+{
+  auto it = PendingReductions_.begin();
+  while (it != PendingReductions_.end()) {
+    const auto & ReduceAs = it->ReduceAs;
+    if (std::find(ReduceAs.begin(), ReduceAs.end(), VarA) == ReduceAs.end()) {
+      ++it;
+      continue;
+    }
+    auto Pending = *it;
+    it = PendingReductions_.erase(it);
+    auto ResultV = Tasker_->loadFuture(*TheModule_, Pending.FutureV, Pending.ResultT);
+    for (unsigned i=0; i<Pending.ReduceAs.size(); ++i) {
+      auto ValueV = TheHelper_.extractValue(ResultV, i);
+      Builder_.CreateStore(ValueV, Pending.ReduceAs[i]);
+    }
+    Tasker_->destroyFuture(*TheModule_, Pending.FutureV);
+  }
+}
+
+//==============================================================================
+// Wait on all outstanding reductions
+//==============================================================================
+void CodeGen::resolveReductions()
+{
+  while (!PendingReductions_.empty())
+    resolveReduction(PendingReductions_.front().ReduceAs.front());
+}
+
 //==============================================================================
 // Destroy a variable
 //==============================================================================
@@ -401,6 +458,56 @@ VariableAlloca * CodeGen::createArray(
   return insertVariable(VarName, {ArrayA, ElementType, SizeExpr});
 }
 
+//==============================================================================
+/// Create an array whose storage lives in the entry block
+//==============================================================================
+VariableAlloca * CodeGen::createStackArray(
+    llvm::StringRef VarName,
+    Type * ElementType,
+    Value * SizeExpr)
+{
+  auto NumVals = cast<ConstantInt>(SizeExpr)->getZExtValue();
+  auto DataT = llvm::ArrayType::get(ElementType, NumVals);
+  auto DataA = TheHelper_.createEntryBlockAlloca(DataT, VarName+"data");
+  auto ArrayA = TheHelper_.createEntryBlockAlloca(ArrayType_, VarName+"vec");
+
+  auto VoidPtrT = llvmType<void*>(TheContext_);
+  auto DataV = TheHelper_.createBitCast(DataA, VoidPtrT);
+  auto DataSizeV = TheHelper_.getTypeSize<int_t>(ElementType);
+  TheHelper_.insertValue(ArrayA, DataV, 0);
+  TheHelper_.insertValue(ArrayA, SizeExpr, 1);
+  TheHelper_.insertValue(ArrayA, SizeExpr, 2);
+  TheHelper_.insertValue(ArrayA, DataSizeV, 3);
+  
+  // nothing to free
+  auto ArrayE = insertVariable(VarName, {ArrayA, ElementType, SizeExpr});
+  ArrayE->setOwner(false);
+  return ArrayE;
+}
+
+//==============================================================================
+/// Create an array from the task's arena
+//==============================================================================
+VariableAlloca * CodeGen::createArenaArray(
+    llvm::StringRef VarName,
+    Type * ElementType,
+    Value * SizeExpr)
+{
+  const auto & AllocateN = librt::DopeVectorArenaAllocate::Name;
+  auto F = TheModule_->getFunction(AllocateN);
+  if (!F) F = librt::RunTimeLib::tryInstall(TheContext_, *TheModule_, AllocateN);
+
+  SizeExpr = TheHelper_.getAsValue(SizeExpr);
+  auto ArrayA = TheHelper_.createEntryBlockAlloca(ArrayType_, VarName+"vec");
+  auto DataSize = TheHelper_.getTypeSize<int_t>(ElementType);
+  Builder_.CreateCall(F, {SizeExpr, DataSize, ArrayA});
+  
+  // released with the task
+  auto ArrayE = insertVariable(VarName, {ArrayA, ElementType, SizeExpr});
+  ArrayE->setOwner(false);
+  return ArrayE;
+}
+
 //==============================================================================
 // Allocate array
 //==============================================================================
@@ -495,6 +602,68 @@ void CodeGen::copyArray(Value* SrcArrayV, Value* TgtArrayA)
   Builder_.CreateCall(F, Args);
 }
 
+//==============================================================================
+// Move Array
+//==============================================================================
+void CodeGen::moveArray(Value* SrcArrayV, Value* TgtArrayA, bool IsNew)
+{
+  const auto & MoveN = librt::DopeVectorMove::Name;
+  auto F = TheModule_->getFunction(MoveN);
+  if (!F) F = librt::RunTimeLib::tryInstall(TheContext_, *TheModule_, MoveN);
+
+  // a new target has nothing to free
+  if (IsNew) Builder_.CreateStore(Constant::getNullValue(ArrayType_), TgtArrayA);
+
+  auto SrcArrayA = TheHelper_.getAsAlloca(SrcArrayV);
+
+  std::vector<Value*> Args = {SrcArrayA, TgtArrayA};
+  Builder_.CreateCall(F, Args);
+}
+
+//==============================================================================
+// Hand a returned array over to the caller
+//==============================================================================
+Value* CodeGen::releaseArray(Value* ArrayV, NodeAST* ArrayExpr)
+{
+  // temporaries and owned variables are given away
+  std::string VarN;
+  if (auto VarExpr = dynamic_cast<VarAccessExprAST*>(ArrayExpr))
+    VarN = VarExpr->getName();
+  else if (auto ArrayExprA = dynamic_cast<ArrayExprAST*>(ArrayExpr))
+    VarN = ArrayExprA->getName();
+  else if (isa<CallInst>(ArrayV))
+    return ArrayV;
+
+  auto VarE = VarN.empty() ? nullptr : getVariable(VarN);
+  if (!VarE) return ArrayV;
+  if (VarE->isOwner()) {
+    VarE->setOwner(false);
+    return ArrayV;
+  }
+
+  // arguments are borrowed, so return a copy
+  auto ArrayA = TheHelper_.createEntryBlockAlloca(ArrayType_, "ret.vec");
+  allocateArray(ArrayA, getArraySize(ArrayV), VarE->getType());
+  copyArray(ArrayV, ArrayA);
+  return TheHelper_.load(ArrayA);
+}
+
+//==============================================================================
+// Can the source of an array assignment be moved
+//==============================================================================
+bool CodeGen::isArrayMovable(Value* SrcArrayV, NodeAST* SrcExpr)
+{
+  // the result of a function call is a temporary
+  if (dynamic_cast<CallExprAST*>(SrcExpr))
+    return isa<CallInst>(SrcArrayV);
+
+  // a variable that is never used again
+  auto VarExpr = dynamic_cast<VarAccessExprAST*>(SrcExpr);
+  if (!VarExpr || !VarExpr->isLastUse()) return false;
+  auto VarE = getVariable(VarExpr->getName());
+  return VarE && VarE->isOwner();
+}
+
 //==============================================================================
 // Load an arrayarray into an alloca
 //==============================================================================
@@ -726,7 +895,13 @@ void CodeGen::visit(ArrayExprAST &e)
   }
 
   auto ArrayN = e.getName();
-  auto ArrayE = createArray(ArrayN, VarT, SizeExpr );
+  VariableAlloca* ArrayE = nullptr;
+  if (e.isStack())
+    ArrayE = createStackArray(ArrayN, VarT, SizeExpr);
+  else if (e.isTaskLocal() && Tasker_->hasArena())
+    ArrayE = createArenaArray(ArrayN, VarT, SizeExpr);
+  else
+    ArrayE = createArray(ArrayN, VarT, SizeExpr);
   auto ArrayA = ArrayE->getAlloca();
 
   if (e.hasSize()) 
@@ -963,10 +1138,21 @@ void CodeGen::visit(CallExprAST &e) {
     }
     return;
   }
+  else if (Name == "blocks") {
+    ValueResult_ = Tasker_->createBlockPartition(
+        *TheModule_,
+        getArg(0),
+        getArg(1),
+        getArg(2));
+    return;
+  }
 
   auto FunPair = getFunction(Name);
   auto CalleeF = FunPair.first;
-  auto IsTask = Tasker_->isTask(Name);
+  auto IsTask = Tasker_->isTask(Name) && !e.isInlined();
+
+  // small leaf tasks are called directly
+  if (e.isInlined()) CalleeF = getInlinedFunction(Name, CalleeF);
     
   std::vector<Value *> ArgVs;
   for (unsigned i = 0; i<e.getNumArgs(); ++i) {
@@ -1014,8 +1200,14 @@ void CodeGen::visit(CallExprAST &e) {
     std::string TmpN = CalleeF->getReturnType()->isVoidTy() ? "" : "calltmp";
 
     if (Name == "print") Tasker_->pushRootGuard(*TheModule_);
+    if (Name == "timer") Tasker_->fence(*TheModule_);
 
-    for (auto & A : ArgVs) A = TheHelper_.getAsValue(A);
+    for (auto & A : ArgVs) {
+      A = TheHelper_.getAsValue(A);
+      // variadic arguments follow the c promotion rules
+      if (CalleeF->isVarArg() && A->getType()->isFloatTy())
+        A = Builder_.CreateFPExt(A, F64Type_);
+    }
     ValueResult_ = Builder_.CreateCall(CalleeF, ArgVs, TmpN);
 
     if (Name == "print") {
@@ -1050,6 +1242,7 @@ void CodeGen::visit(ExprListAST & e) {
 // Break statement
 //==============================================================================
 void CodeGen::visit(BreakStmtAST &) {
+  resolveReductions();
   if (ExitBlock_) Builder_.CreateBr(ExitBlock_);
 }
 
@@ -1064,6 +1257,9 @@ void CodeGen::visit(IfStmtAST & e) {
     return;
   }
 
+  // branches cannot be relied on to wait on reductions
+  resolveReductions();
+
   Value *CondV = runExprVisitor(*e.getCondExpr());
   CondV = TheHelper_.getAsValue(CondV);
   auto CondT = CondV->getType();
@@ -1091,6 +1287,7 @@ void CodeGen::visit(IfStmtAST & e) {
 
   createScope();
   for ( const auto & stmt : e.getThenExprs() ) runStmtVisitor(*stmt);
+  resolveReductions();
   popScope();
 
   // get first non phi instruction
@@ -1109,6 +1306,7 @@ void CodeGen::visit(IfStmtAST & e) {
 
     createScope();
     for ( const auto & stmt : e.getElseExprs() ) runStmtVisitor(*stmt); 
+    resolveReductions();
     popScope();
 
     // get first non phi
@@ -1154,6 +1352,9 @@ void CodeGen::visit(IfStmtAST & e) {
 //==============================================================================
 void CodeGen::visit(ForStmtAST& e) {
   
+  // loop bodies cannot be relied on to wait on reductions
+  resolveReductions();
+
   auto TheFunction = Builder_.GetInsertBlock()->getParent();
   
   createScope();
@@ -1213,6 +1414,10 @@ void CodeGen::visit(ForStmtAST& e) {
   auto OldExitBlock = ExitBlock_;
   ExitBlock_ = AfterBB;
 
+  // loops that repeat the same launches let the runtime replay its analysis
+  AllocaInst* TraceA = nullptr;
+  if (e.isTraceable()) TraceA = Tasker_->createTrace(*TheModule_);
+
   Builder_.CreateBr(BeforeBB);
   Builder_.SetInsertPoint(BeforeBB);
 
@@ -1235,6 +1440,7 @@ void CodeGen::visit(ForStmtAST& e) {
   // Emit the body of the loop.  This, like any other expr, can change the
   // current BB.  Note that we ignore the value computed by the body, but don't
   // allow an error.
+  if (TraceA) Tasker_->beginTrace(*TheModule_, TraceA);
   createScope();
   bool HasBreak = 0;
   for ( auto & Stmt : e.getBodyExprs() ) {
@@ -1243,7 +1449,10 @@ void CodeGen::visit(ForStmtAST& e) {
     runStmtVisitor(*StmtPtr);
     if (HasBreak) break;
   }
+  // the next iteration can not rely on waiting for this one
+  resolveReductions();
   popScope();
+  if (TraceA) Tasker_->endTrace(*TheModule_, TraceA);
 
 
   // Insert unconditional branch to increment.
@@ -1335,13 +1544,6 @@ void CodeGen::visit(ForeachStmtAST& e)
     // Launch Task
 	  
     if (e.hasReduction() && TaskI.hasReduction()) {
-      auto FutureV = Tasker_->launch(
-          *TheModule_,
-          TaskI,
-          TaskArgAs,
-          PartAs,
-          RangeV,
-          TaskI.getReduction());
       
       std::vector<VariableType> ReduceTypes;
       std::vector<Value*> ReduceAs;
@@ -1351,15 +1553,54 @@ void CodeGen::visit(ForeachStmtAST& e)
         auto VarE = getVariable( VarD->getName() );
         ReduceAs.emplace_back( VarE->getAlloca() );
       }
+      
+      // every index point starts from the identity instead of the old value
+      std::vector<Value*> OldVs;
+      if (e.isAccumulate()) {
+        for (unsigned i=0; i<ReduceAs.size(); ++i) {
+          resolveReduction(ReduceAs[i]);
+          auto OldV = TheHelper_.load(ReduceAs[i]);
+          OldVs.emplace_back(OldV);
+          auto Op = e.getReductionVars()[i].getType();
+          auto InitC = Tasker_->initReduce(OldV->getType(), Op);
+          Builder_.CreateStore(InitC, ReduceAs[i]);
+        }
+      }
+
+      auto FutureV = Tasker_->launch(
+          *TheModule_,
+          TaskI,
+          TaskArgAs,
+          PartAs,
+          RangeV,
+          TaskI.getReduction());
 
       auto ResultType = VariableType(ReduceTypes);
       auto ResultT = getLLVMType(ResultType);
 
-      auto ResultV = Tasker_->loadFuture(*TheModule_, FutureV, ResultT);
-
-      for (unsigned i=0; i<ReduceAs.size(); ++i) {
-        auto ValueV = TheHelper_.extractValue(ResultV, i);
-        Builder_.CreateStore(ValueV, ReduceAs[i]);
+      // fold the old values back in
+      if (e.isAccumulate()) {
+        auto ResultV = FutureV;
+        if (Tasker_->isFuture(FutureV))
+          ResultV = Tasker_->loadFuture(*TheModule_, FutureV, ResultT);
+        for (unsigned i=0; i<ReduceAs.size(); ++i) {
+          auto ValueV = TheHelper_.extractValue(ResultV, i);
+          auto Op = e.getReductionVars()[i].getType();
+          ValueV = Tasker_->foldReduce(*TheModule_, OldVs[i], ValueV, Op);
+          Builder_.CreateStore(ValueV, ReduceAs[i]);
+        }
+        if (Tasker_->isFuture(FutureV))
+          Tasker_->destroyFuture(*TheModule_, FutureV);
+      }
+      // asynchronous results are only waited on at first use
+      else if (Tasker_->isFuture(FutureV)) {
+        deferReduction(FutureV, ResultT, ReduceAs);
+      }
+      else {
+        for (unsigned i=0; i<ReduceAs.size(); ++i) {
+          auto ValueV = TheHelper_.extractValue(FutureV, i);
+          Builder_.CreateStore(ValueV, ReduceAs[i]);
+        }
       }
     }
     else {
@@ -1438,9 +1679,15 @@ void CodeGen::assignManyToOne(
       auto ArrayExpr = dynamic_cast<ArrayExprAST*>(RightExpr);
       if (i==0 && ArrayExpr) {
         if (!VarInserted) destroyVariable(*VarE);
-        VarE->setAlloca(Right, true);
+        auto ArrayE = getVariable(ArrayExpr->getName());
+        VarE->setAlloca(Right, ArrayE->isOwner());
         eraseVariable(ArrayExpr->getName());
       }
+      // steal the memory once nobody else needs it
+      else if (i+1==NumLeft && isArrayMovable(RightV, RightExpr)) {
+        moveArray(RightV, VarA, VarInserted);
+        VarE->setOwner(true);
+      }
       // otherwise, just copy it
       else {
         if (VarInserted) {
@@ -1557,9 +1804,15 @@ void CodeGen::assignManyToMany(
       // steal the alloca
       if (auto ArrayExpr = dynamic_cast<ArrayExprAST*>(RightExpr)) {
         if (!VarInserted) destroyVariable(*VarE);
-        VarE->setAlloca(RightV, true);
+        auto ArrayE = getVariable(ArrayExpr->getName());
+        VarE->setAlloca(RightV, ArrayE->isOwner());
         eraseVariable(ArrayExpr->getName());
       }
+      // steal the memory once nobody else needs it
+      else if (isArrayMovable(RightV, RightExpr)) {
+        moveArray(RightV, VarA, VarInserted);
+        VarE->setOwner(true);
+      }
       else {
         if (VarInserted) {
           auto SizeV = TheHelper_.extractValue(RightV, 1);
@@ -1696,6 +1949,13 @@ Value* CodeGen::codegenFunctionBody(FunctionAST& e)
   for ( auto & stmt : e.getBodyExprs() )
   {
     runStmtVisitor(*stmt);
+    // fields no longer needed are freed right away
+    for (const auto & VarN : e.getReleases(stmt.get())) {
+      auto VarE = getVariable(VarN);
+      if (!VarE) continue;
+      destroyVariable(*VarE);
+      VarE->setOwner(false);
+    }
   }
 
   // Finish off the function.
@@ -1705,6 +1965,8 @@ Value* CodeGen::codegenFunctionBody(FunctionAST& e)
     if (RetVal) RetVal = TheHelper_.getAsValue(RetVal);
   }
 
+  resolveReductions();
+
   return RetVal;
 }
 
@@ -1758,6 +2020,10 @@ void CodeGen::visit(FunctionAST& e)
   // codegen the function body
   auto RetVal = codegenFunctionBody(e);
 
+  // the caller takes over returned arrays
+  if (RetVal && isArray(RetVal))
+    RetVal = releaseArray(RetVal, e.getReturnExpr());
+
   // garbage collection
   if (CreatedScope) popScope();
   
@@ -1778,6 +2044,55 @@ void CodeGen::visit(FunctionAST& e)
 
 }
 
+//==============================================================================
+/// Get the plain version of a task
+//==============================================================================
+Function* CodeGen::getInlinedFunction(
+    const std::string & Name,
+    Function* TaskF)
+{
+  auto InlineN = Name + ".inline";
+  if (auto F = TheModule_->getFunction(InlineN)) return F;
+  return Function::Create(
+      TaskF->getFunctionType(),
+      Function::ExternalLinkage,
+      InlineN,
+      *TheModule_);
+}
+
+//==============================================================================
+/// Generate the plain version of a task
+//==============================================================================
+void CodeGen::codegenInlinedTask(TaskAST& e, Function* TaskF)
+{
+  auto TheFunction = getInlinedFunction(e.getName(), TaskF);
+  
+  BasicBlock *BB = BasicBlock::Create(TheContext_, "entry", TheFunction);
+  Builder_.SetInsertPoint(BB);
+
+  createScope();
+  
+  auto TaskArg = TaskF->arg_begin();
+  for (auto &Arg : TheFunction->args()) {
+    Arg.setName(TaskArg->getName());
+    auto VarE = createVariable(Arg.getName(), Arg.getType());
+    VarE->setOwner(false);
+    Builder_.CreateStore(&Arg, VarE->getAlloca());
+    TaskArg++;
+  }
+
+  auto RetVal = codegenFunctionBody(e);
+  
+  popScope();
+  
+  if (RetVal && !RetVal->getType()->isVoidTy())
+    Builder_.CreateRet(RetVal);
+  else
+    Builder_.CreateRetVoid();
+  
+  verifyFunction(*TheFunction);
+}
+
 //==============================================================================
 /// TaskAST - This class represents a function definition itself.
 //==============================================================================
@@ -1795,6 +2110,10 @@ void CodeGen::visit(TaskAST& e)
   auto Name = P.getName();
   auto TheFunction = getFunction(Name).first;
   
+  // a plain version for callers that skip the launch
+  auto FunDef = e.getFunctionDef();
+  if (FunDef && FunDef->isInline()) codegenInlinedTask(e, TheFunction);
+  
   // generate wrapped task
   auto Wrapper = Tasker_->taskPreamble(*TheModule_, Name, TheFunction);
   
@@ -1802,6 +2121,11 @@ void CodeGen::visit(TaskAST& e)
   auto & TaskI = Tasker_->insertTask(Name, Wrapper.TheFunction);
   TaskI.setLeaf(e.isLeaf());
 
+  std::vector<FieldAccess> ArgAccesses;
+  for (auto &Arg : TheFunction->args())
+    ArgAccesses.emplace_back( e.getFieldAccess(Arg.getName().str()) );
+  TaskI.setArgAccesses(ArgAccesses);
+
   // insert arguments into variable table
   unsigned ArgIdx = 0;
   for (auto &Arg : TheFunction->args()) {
@@ -1852,31 +2176,52 @@ void CodeGen::visit(IndexTaskAST& e)
   // Reduction Op
   Type* ResultT = nullptr;
   std::unique_ptr<AbstractReduceInfo> RedopInfo;
+  std::vector<std::unique_ptr<AbstractReduceInfo>> ArgRedopInfos;
 
-  if (e.hasReduction()) {
+  if (e.hasReduction() || e.hasArgReduction()) {
    
-    std::vector<VariableType> ReduceTypes;
-    std::vector<Type*> ReduceTs;
-    std::vector<ReductionType> ReduceOps;
-
-    for (auto ReduceD : e.getReductionDefs()) {
-      auto VarD = ReduceD.getVariableDef();
-      auto VarType = VarD->getType();
-      ReduceTs.emplace_back(getLLVMType(VarType));
-      ReduceTypes.emplace_back(VarType);
-      ReduceOps.emplace_back(ReduceD.getType());
-    }
-    auto ReturnType = VariableType(ReduceTypes);
-    ResultT = getLLVMType(ReturnType);
-
     auto ModulePtr = (DeviceJIT_) ?
       new Module("temporary module", TheContext_) : TheModule_.get(); 
 
-    RedopInfo = Tasker_->createReductionOp(
-          *ModulePtr,
-          TaskN,
-          ReduceTs,
-          ReduceOps);
+    if (e.hasReduction()) {
+      std::vector<VariableType> ReduceTypes;
+      std::vector<Type*> ReduceTs;
+      std::vector<ReductionType> ReduceOps;
+
+      for (auto ReduceD : e.getReductionDefs()) {
+        auto VarD = ReduceD.getVariableDef();
+        auto VarType = VarD->getType();
+        ReduceTs.emplace_back(getLLVMType(VarType));
+        ReduceTypes.emplace_back(VarType);
+        ReduceOps.emplace_back(ReduceD.getType());
+      }
+      auto ReturnType = VariableType(ReduceTypes);
+      ResultT = getLLVMType(ReturnType);
+
+      RedopInfo = Tasker_->createReductionOp(
+            *ModulePtr,
+            TaskN,
+            ReduceTs,
+            ReduceOps);
+    }
+
+    // reduced fields or arrays get an op for their entries if the backend
+    // does not combine them itself
+    for (auto ReduceD : e.getArgReductionDefs()) {
+      auto VarD = ReduceD.getVariableDef();
+      if (VarD->getType().isArray() && !Tasker_->hasArrayReductions())
+        THROW_CONTRA_ERROR("Array reductions are not supported by this backend.");
+      std::unique_ptr<AbstractReduceInfo> ArgRedop;
+      if (Tasker_->needsArgReductionOps()) {
+        auto VarT = getLLVMType( strip(VarD->getType()) );
+        ArgRedop = Tasker_->createReductionOp(
+            *ModulePtr,
+            TaskN + "." + VarD->getName(),
+            {VarT},
+            {ReduceD.getType()});
+      }
+      ArgRedopInfos.emplace_back( std::move(ArgRedop) );
+    }
 
     if (DeviceJIT_) {
       utils::insertModule(*ModulePtr, *TheModule_);
@@ -1962,8 +2307,27 @@ void CodeGen::visit(IndexTaskAST& e)
 	// register it
   auto & TaskI = Tasker_->insertTask(TaskN, Wrapper.TheFunction);
   TaskI.setLeaf(e.isLeaf());
+  
+  std::vector<FieldAccess> ArgAccesses;
+  for (const auto & ArgN : TaskArgNs)
+    ArgAccesses.emplace_back( e.getFieldAccess(ArgN) );
+  TaskI.setArgAccesses(ArgAccesses);
+
   if (RedopInfo) TaskI.setReduction( std::move(RedopInfo) );
 
+  unsigned ArgRedopIdx = 0;
+  for (auto ReduceD : e.getArgReductionDefs()) {
+    auto & ArgRedop = ArgRedopInfos[ArgRedopIdx++];
+    auto VarD = ReduceD.getVariableDef();
+    auto it = std::find(TaskArgNs.begin(), TaskArgNs.end(), VarD->getName());
+    if (it == TaskArgNs.end()) continue;
+    TaskI.setArgReduction(
+        std::distance(TaskArgNs.begin(), it),
+        ReduceD.getType(),
+        getLLVMType( strip(VarD->getType()) ),
+        std::move(ArgRedop));
+  }
+
  	verifyFunction(*Wrapper.TheFunction);
 
   // Compile device code
@@ -63,7 +63,9 @@ class CodeGen : public RecursiveAstVisiter {
   std::map< std::vector<llvm::Type*>, llvm::StructType* > StructTable_;
 
   // defined types
+  Type* I32Type_ = nullptr;
   Type* I64Type_ = nullptr;
+  Type* F32Type_ = nullptr;
   Type* F64Type_ = nullptr;
   Type* VoidType_ = nullptr;
   Type* ArrayType_ = nullptr;
@@ -72,6 +74,14 @@ class CodeGen : public RecursiveAstVisiter {
   // task interface
   std::unique_ptr<AbstractTasker> Tasker_;
 
+  // reductions whose results have not been waited on yet
+  struct PendingReduction {
+    Value* FutureV = nullptr;
+    Type* ResultT = nullptr;
+    std::vector<Value*> ReduceAs;
+  };
+  std::vector<PendingReduction> PendingReductions_;
+
 public:
   
   //============================================================================
@@ -182,6 +192,8 @@ private:
 
   // visitor helpers
   llvm::Value* codegenFunctionBody(FunctionAST& e);
+  void codegenInlinedTask(TaskAST& e, llvm::Function*);
+  llvm::Function* getInlinedFunction(const std::string &, llvm::Function*);
 
   using RightExprTuple = std::tuple<Value*, const VariableType &, ExprAST*>;
   void assignManyToOne(AssignStmtAST &, const RightExprTuple &);
@@ -236,6 +248,19 @@ private:
   void destroyVariable(const VariableAlloca &);
   void eraseVariable(const std::string &);
 
+  //============================================================================
+  // Reduction interface
+  //============================================================================
+
+  // defer waiting on a reduction future until its variables are used
+  void deferReduction(Value*, Type*, const std::vector<Value*> &);
+
+  // wait on any reductions that target a variable
+  void resolveReduction(Value*);
+
+  // wait on all outstanding reductions
+  void resolveReductions();
+
   //============================================================================
   // Array interface
   //============================================================================
@@ -255,6 +280,18 @@ private:
       llvm::StringRef VarName,
       Type* ElementType);
   
+  // create a constant size array in the entry block
+  VariableAlloca * createStackArray(
+      llvm::StringRef VarName,
+      Type* ElementType,
+      Value * SizeExpr );
+  
+  // create an array that lives until the task finishes
+  VariableAlloca * createArenaArray(
+      llvm::StringRef VarName,
+      Type* ElementType,
+      Value * SizeExpr );
+  
   void allocateArray(
       Value* ArrayA,
       Value * SizeV,
@@ -276,6 +313,13 @@ private:
   // copies one array to another
   void copyArray(Value* Src, Value* Tgt);
 
+  // moves one array into another, leaving the source empty
+  void moveArray(Value* Src, Value* Tgt, bool IsNew);
+  bool isArrayMovable(Value* Src, NodeAST* SrcExpr);
+
+  // gives a returned array to the caller
+  Value* releaseArray(Value* Array, NodeAST* ArrayExpr);
+
   // destroy all arrays
   void destroyArray(Value*);
   void destroyArrays(const std::vector<Value*> &);
@@ -8,7 +8,9 @@ namespace contra {
 Context::Context()
 {
   // add builtins
+  I32Type_ = insertType(std::make_unique<BuiltInTypeDef>("i32", TypeDef::Attr::Number)).get();
   I64Type_ = insertType(std::make_unique<BuiltInTypeDef>("i64", TypeDef::Attr::Number)).get();
+  F32Type_ = insertType(std::make_unique<BuiltInTypeDef>("f32", TypeDef::Attr::Number)).get();
   F64Type_ = insertType(std::make_unique<BuiltInTypeDef>("f64", TypeDef::Attr::Number)).get();
   StrType_ = insertType(std::make_unique<BuiltInTypeDef>("string")).get();
   BoolType_ = insertType(std::make_unique<BuiltInTypeDef>("bool")).get();
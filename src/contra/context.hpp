@@ -61,7 +61,9 @@ class Context {
   NestedData* CurrentScope_ = nullptr;
   
   // builtin types
+  TypeDef* I32Type_ = nullptr;
   TypeDef* I64Type_ = nullptr;
+  TypeDef* F32Type_ = nullptr;
   TypeDef* F64Type_ = nullptr;
   TypeDef* StrType_ = nullptr;
   TypeDef* BoolType_ = nullptr;
@@ -78,7 +80,9 @@ public:
   }
 
   // get user defined types
+  auto getInt32Type() const { return I32Type_; }
   auto getInt64Type() const { return I64Type_; }
+  auto getFloat32Type() const { return F32Type_; }
   auto getFloat64Type() const { return F64Type_; }
   auto getStringType() const { return StrType_; }
   auto getBoolType() const { return BoolType_; }
@@ -1,8 +1,15 @@
+#include "accesses.hpp"
 #include "contra.hpp"
 #include "errors.hpp"
+#include "escapes.hpp"
+#include "fusions.hpp"
 #include "futures.hpp"
+#include "inlines.hpp"
 #include "leafs.hpp"
+#include "lifetimes.hpp"
 #include "loops.hpp"
+#include "moves.hpp"
+#include "traces.hpp"
 
 #include "utils/file_utils.hpp"
 
@@ -56,6 +63,14 @@ void Contra::setup(const std::string & FileName)
 std::vector<std::unique_ptr<FunctionAST>>
   Contra::optimizeFunction(std::unique_ptr<FunctionAST> F)
 {
+  // turn independent loops into foreach loops
+  LoopParallelizer TheParallelizer;
+  TheParallelizer.runVisitor(*F);
+
+  // merge back-to-back foreach loops
+  LoopFuser TheFuser;
+  TheFuser.runVisitor(*F);
+
   // lift index tasks
   LoopLifter TheLifter;
   TheLifter.runVisitor(*F);
@@ -74,6 +89,30 @@ std::vector<std::unique_ptr<FunctionAST>>
   LeafIdentifier TheLeaf;
   for ( const auto & FnAST : Fs )  TheLeaf.runVisitor(*FnAST);
   
+  // identify leafs that are cheap enough to call directly
+  InlineIdentifier TheInline;
+  for ( const auto & FnAST : Fs )  TheInline.runVisitor(*FnAST);
+  
+  // identify how leafs touch their fields
+  AccessIdentifier TheAccess;
+  for ( const auto & FnAST : Fs )  TheAccess.runVisitor(*FnAST);
+  
+  // identify loops that repeat the same launches
+  TraceIdentifier TheTrace;
+  for ( const auto & FnAST : Fs )  TheTrace.runVisitor(*FnAST);
+  
+  // identify arrays that can be moved instead of copied
+  MoveIdentifier TheMove;
+  for ( const auto & FnAST : Fs )  TheMove.runVisitor(*FnAST);
+  
+  // identify arrays that can live on the stack
+  EscapeIdentifier TheEscape;
+  for ( const auto & FnAST : Fs )  TheEscape.runVisitor(*FnAST);
+  
+  // identify where fields can be released
+  LifetimeIdentifier TheLifetime;
+  for ( const auto & FnAST : Fs )  TheLifetime.runVisitor(*FnAST);
+  
   return Fs;
 }
 
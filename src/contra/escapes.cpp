@@ -0,0 +1,122 @@
+#include "args.hpp"
+#include "escapes.hpp"
+
+namespace contra {
+
+using namespace llvm;
+
+////////////////////////////////////////////////////////////////////////////////
+// Escape args
+////////////////////////////////////////////////////////////////////////////////
+
+cl::opt<unsigned> OptionStackArrayLimit(
+    "stack-array-limit",
+    cl::desc("Place constant size arrays with at most this many entries "
+      "on the stack (0 disables)"),
+    cl::init(64),
+    cl::cat(OptionCategory));
+
+//==============================================================================
+void EscapeIdentifier::runVisitor(FunctionAST&e)
+{
+  // top level variables outlive the expression
+  if (e.isTopLevelExpression()) return;
+
+  LoopDepth_ = 0;
+  IsTask_ = e.isTask();
+  NumAssigns_.clear();
+  StackCandidates_.clear();
+  TaskCandidates_.clear();
+  Escaped_.clear();
+
+  e.accept(*this);
+  if (e.hasReturn()) checkReturn(e.getReturnExpr());
+
+  // the storage is only safe if nothing else is ever assigned to it
+  auto IsLocal = [&](const std::string & VarN)
+  { return NumAssigns_.at(VarN) == 1 && !Escaped_.count(VarN); };
+
+  for (const auto & Candidate : StackCandidates_)
+    if (IsLocal(Candidate.first)) Candidate.second->setStack();
+  
+  for (const auto & Candidate : TaskCandidates_)
+    if (IsLocal(Candidate.first)) Candidate.second->setTaskLocal();
+}
+
+//==============================================================================
+void EscapeIdentifier::checkReturn(NodeAST* Expr)
+{
+  if (auto ExprList = dynamic_cast<ExprListAST*>(Expr)) {
+    for (const auto & E : ExprList->getExprs()) checkReturn(E.get());
+  }
+  else if (auto VarExpr = dynamic_cast<VarAccessExprAST*>(Expr)) {
+    Escaped_.emplace(VarExpr->getName());
+  }
+}
+
+//==============================================================================
+bool EscapeIdentifier::isSmall(ArrayExprAST& e)
+{
+  if (!OptionStackArrayLimit) return false;
+  std::size_t Size = e.getNumVals();
+  if (e.hasSize()) {
+    auto SizeExpr = dynamic_cast<ValueExprAST*>(e.getSizeExpr());
+    if (!SizeExpr || SizeExpr->getValueType() != ValueExprAST::ValueType::Int)
+      return false;
+    auto Val = SizeExpr->getVal<int_t>();
+    if (Val < 0) return false;
+    Size = Val;
+  }
+  return Size <= OptionStackArrayLimit;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Vizitors
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+bool EscapeIdentifier::preVisit(ForStmtAST&)
+{
+  LoopDepth_++;
+  return false;
+}
+
+//==============================================================================
+void EscapeIdentifier::postVisit(ForStmtAST&)
+{ LoopDepth_--; }
+
+//==============================================================================
+bool EscapeIdentifier::preVisit(ForeachStmtAST&)
+{
+  LoopDepth_++;
+  return false;
+}
+
+//==============================================================================
+void EscapeIdentifier::postVisit(ForeachStmtAST&)
+{ LoopDepth_--; }
+
+//==============================================================================
+void EscapeIdentifier::postVisit(AssignStmtAST& e)
+{
+  auto NumLeft = e.getNumLeftExprs();
+  for (unsigned i=0; i<NumLeft; ++i) {
+    auto LeftExpr = e.getLeftExpr(i);
+    if (dynamic_cast<ArrayAccessExprAST*>(LeftExpr)) continue;
+    auto VarExpr = dynamic_cast<VarAccessExprAST*>(LeftExpr);
+    if (!VarExpr) continue;
+    const auto & VarN = VarExpr->getName();
+    NumAssigns_[VarN]++;
+
+    if (NumLeft != 1 || e.getNumRightExprs() != 1 || e.getCast(0)) continue;
+    auto ArrayExpr = dynamic_cast<ArrayExprAST*>(e.getRightExpr(0));
+    if (!ArrayExpr) continue;
+    if (isSmall(*ArrayExpr))
+      StackCandidates_.emplace(VarN, ArrayExpr);
+    // the arena is only reset once the task finishes
+    else if (IsTask_ && !LoopDepth_)
+      TaskCandidates_.emplace(VarN, ArrayExpr);
+  }
+}
+
+} // namespace
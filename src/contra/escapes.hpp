@@ -0,0 +1,45 @@
+#ifndef CONTRA_ESCAPES_HPP
+#define CONTRA_ESCAPES_HPP
+
+#include "config.hpp"
+#include "recursive.hpp"
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Identifies arrays that never leave their function or task
+////////////////////////////////////////////////////////////////////////////////
+class EscapeIdentifier : public RecursiveAstVisiter {
+
+  unsigned LoopDepth_ = 0;
+  bool IsTask_ = false;
+
+  std::map<std::string, unsigned> NumAssigns_;
+  std::map<std::string, ArrayExprAST*> StackCandidates_;
+  std::map<std::string, ArrayExprAST*> TaskCandidates_;
+  std::set<std::string> Escaped_;
+
+  void checkReturn(NodeAST* Expr);
+  bool isSmall(ArrayExprAST& e);
+
+public:
+
+  void runVisitor(FunctionAST&e);
+
+  bool preVisit(ForStmtAST& e) override;
+  void postVisit(ForStmtAST& e) override;
+
+  bool preVisit(ForeachStmtAST& e) override;
+  void postVisit(ForeachStmtAST& e) override;
+
+  void postVisit(AssignStmtAST& e) override;
+
+};
+
+} // namespace
+
+#endif // CONTRA_ESCAPES_HPP
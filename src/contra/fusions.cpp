@@ -0,0 +1,295 @@
+#include "args.hpp"
+#include "fusions.hpp"
+
+#include <algorithm>
+
+namespace contra {
+
+using namespace llvm;
+
+////////////////////////////////////////////////////////////////////////////////
+// Fusion args
+////////////////////////////////////////////////////////////////////////////////
+
+cl::opt<bool> OptionFuseLoops(
+    "fuse-loops",
+    cl::desc("Merge consecutive foreach loops over the same range"),
+    cl::init(true),
+    cl::cat(OptionCategory));
+
+namespace {
+
+//==============================================================================
+// Collects the variables a loop body touches
+//==============================================================================
+struct AccessCollector : public RecursiveAstVisiter {
+
+  const std::set<VariableDef*> & Outer;
+  std::set<VariableDef*> & Written;
+  std::set<std::string> & Locals;
+  std::set<std::string> & NestedLocals;
+  bool HasSideEffects = false;
+  unsigned Depth = 0;
+
+  AccessCollector(
+      const std::set<VariableDef*> & O,
+      std::set<VariableDef*> & W,
+      std::set<std::string> & L,
+      std::set<std::string> & N) :
+    Outer(O), Written(W), Locals(L), NestedLocals(N)
+  {}
+
+  bool preVisit(ForStmtAST&) override { Depth++; return false; }
+  void postVisit(ForStmtAST&) override { Depth--; }
+
+  bool preVisit(IfStmtAST&) override { Depth++; return false; }
+  void postVisit(IfStmtAST&) override { Depth--; }
+
+  bool preVisit(AssignStmtAST& e) override {
+    for (const auto & Expr : e.getLeftExprs()) {
+      auto VarExpr = dynamic_cast<VarAccessExprAST*>(Expr.get());
+      if (!VarExpr) continue;
+      auto VarDef = VarExpr->getVariableDef();
+      if (Outer.count(VarDef)) Written.emplace(VarDef);
+      // nested blocks get their own scope
+      else if (!Depth) Locals.emplace(VarExpr->getName());
+      else NestedLocals.emplace(VarExpr->getName());
+    }
+    return false;
+  }
+
+  // user functions may print or launch tasks themselves
+  void postVisit(CallExprAST& e) override {
+    const auto & Name = e.getName();
+    auto FunDef = e.getFunctionDef();
+    if (!dynamic_cast<BuiltInFunction*>(FunDef) || Name == "print" ||
+        Name == "timer")
+      HasSideEffects = true;
+  }
+};
+
+} // namespace
+
+//==============================================================================
+void LoopFuser::runVisitor(FunctionAST&e)
+{
+  if (!OptionFuseLoops) return;
+
+  auto Fused = fuseBlock(e.getBodyExprs());
+  for (auto it=Fused.rbegin(); it!=Fused.rend(); ++it) e.eraseBodyExpr(*it);
+
+  e.accept(*this);
+}
+
+//==============================================================================
+LoopFuser::LoopAccesses LoopFuser::getAccesses(ForeachStmtAST& e)
+{
+  LoopAccesses Accesses;
+
+  const auto & AccessedVars = e.getAccessedVariables();
+  Accesses.Accessed.insert(AccessedVars.begin(), AccessedVars.end());
+
+  const auto & BodyExprs = e.getBodyExprs();
+  auto NumQual = e.getNumQualifiers();
+
+  for (unsigned i=0; i<NumQual; ++i) {
+    auto BodyExpr = BodyExprs[i].get();
+    if (auto PartExpr = dynamic_cast<PartitionStmtAST*>(BodyExpr)) {
+      // partitions are only comparable through the variable holding them
+      VariableDef* PartDef = nullptr;
+      auto VarExpr = dynamic_cast<VarAccessExprAST*>(PartExpr->getPartExpr());
+      if (VarExpr && !dynamic_cast<ArrayAccessExprAST*>(VarExpr))
+        PartDef = VarExpr->getVariableDef();
+      auto NumVars = PartExpr->getNumVars();
+      for (unsigned j=0; j<NumVars; ++j)
+        Accesses.Partitions.emplace(PartExpr->getVarName(j), PartDef);
+    }
+    else if (auto ReduceExpr = dynamic_cast<ReductionStmtAST*>(BodyExpr)) {
+      auto NumVars = ReduceExpr->getNumVars();
+      for (unsigned j=0; j<NumVars; ++j)
+        Accesses.Reduced.emplace(ReduceExpr->getVarDef(j));
+    }
+  }
+
+  AccessCollector Collector(
+      Accesses.Accessed,
+      Accesses.Written,
+      Accesses.Locals,
+      Accesses.NestedLocals);
+  auto NumBody = BodyExprs.size();
+  for (unsigned i=NumQual; i<NumBody; ++i) BodyExprs[i]->accept(Collector);
+  Accesses.HasSideEffects = Collector.HasSideEffects;
+
+  return Accesses;
+}
+
+//==============================================================================
+bool LoopFuser::isSameRange(NodeAST* A, NodeAST* B)
+{
+  auto IsVar = [](NodeAST* Expr) -> VarAccessExprAST* {
+    if (dynamic_cast<ArrayAccessExprAST*>(Expr)) return nullptr;
+    return dynamic_cast<VarAccessExprAST*>(Expr);
+  };
+  auto IsInt = [](NodeAST* Expr) -> ValueExprAST* {
+    auto ValueExpr = dynamic_cast<ValueExprAST*>(Expr);
+    if (!ValueExpr || ValueExpr->getValueType() != ValueExprAST::ValueType::Int)
+      return nullptr;
+    return ValueExpr;
+  };
+  auto IsSameInt = [&](NodeAST* X, NodeAST* Y) {
+    auto IntX = IsInt(X);
+    auto IntY = IsInt(Y);
+    return IntX && IntY && IntX->getVal<int_t>() == IntY->getVal<int_t>();
+  };
+
+  // the same range variable
+  auto VarA = IsVar(A);
+  auto VarB = IsVar(B);
+  if (VarA && VarB)
+    return VarA->getVariableDef() == VarB->getVariableDef();
+
+  // or the same constant bounds
+  auto RangeA = dynamic_cast<RangeExprAST*>(A);
+  auto RangeB = dynamic_cast<RangeExprAST*>(B);
+  if (!RangeA || !RangeB || RangeA->hasStepExpr() || RangeB->hasStepExpr())
+    return false;
+  return IsSameInt(RangeA->getStartExpr(), RangeB->getStartExpr()) &&
+    IsSameInt(RangeA->getEndExpr(), RangeB->getEndExpr());
+}
+
+//==============================================================================
+bool LoopFuser::isFusable(ForeachStmtAST& A, ForeachStmtAST& B)
+{
+  if (A.isAccumulate() || B.isAccumulate()) return false;
+  if (A.getVarName() != B.getVarName()) return false;
+  if (!isSameRange(A.getStartExpr(), B.getStartExpr())) return false;
+
+  auto AccessA = getAccesses(A);
+  auto AccessB = getAccesses(B);
+
+  // output would be interleaved differently
+  if (AccessA.HasSideEffects || AccessB.HasSideEffects) return false;
+
+  // both must see the same pieces of anything they share
+  for (const auto & Part : AccessB.Partitions) {
+    auto it = AccessA.Partitions.find(Part.first);
+    if (it != AccessA.Partitions.end() && it->second != Part.second)
+      return false;
+  }
+
+  for (auto VarDef : AccessB.Accessed) {
+    if (!AccessA.Accessed.count(VarDef)) continue;
+
+    // reduced values are only final once the whole launch is done
+    if (AccessA.Reduced.count(VarDef) || AccessB.Reduced.count(VarDef))
+      return false;
+
+    const auto & VarN = VarDef->getName();
+    auto PartA = AccessA.Partitions.find(VarN);
+    auto PartB = AccessB.Partitions.find(VarN);
+    bool HasPartA = PartA != AccessA.Partitions.end();
+    bool HasPartB = PartB != AccessB.Partitions.end();
+    if (HasPartA != HasPartB) return false;
+    if (HasPartA && !PartA->second) return false;
+
+    bool IsWritten =
+      AccessA.Written.count(VarDef) || AccessB.Written.count(VarDef);
+
+    if (VarDef->getType().isField()) {
+      // user partitions may overlap, so a write could land in another point
+      if (IsWritten && HasPartA) return false;
+    }
+    // every task works on its own copy of everything else
+    else if (AccessA.Written.count(VarDef)) {
+      return false;
+    }
+  }
+
+  for (auto VarDef : AccessB.Reduced)
+    if (AccessA.Reduced.count(VarDef)) return false;
+
+  // variables left in scope by the first body would be picked up by the second
+  for (const auto & VarN : AccessA.Locals)
+    if (AccessB.Locals.count(VarN) || AccessB.NestedLocals.count(VarN))
+      return false;
+
+  return true;
+}
+
+//==============================================================================
+// Moves the qualifiers and body of B into A
+//==============================================================================
+void LoopFuser::fuse(ForeachStmtAST& A, ForeachStmtAST& B)
+{
+  auto NumQualA = A.getNumQualifiers();
+  auto NumQualB = B.getNumQualifiers();
+  auto NumBodyB = B.getBodyExprs().size();
+
+  for (unsigned i=0; i<NumQualB; ++i)
+    A.insertBodyExpr(NumQualA+i, B.moveBodyExpr(i));
+  for (unsigned i=NumQualB; i<NumBodyB; ++i)
+    A.insertBodyExpr(A.getBodyExprs().size(), B.moveBodyExpr(i));
+
+  A.setNumQualifiers(NumQualA + NumQualB);
+  if (B.hasReduction()) A.setHasReduction();
+
+  std::set<VariableDef*> VarDefs;
+  VarDefs.insert(A.getAccessedVariables().begin(), A.getAccessedVariables().end());
+  VarDefs.insert(B.getAccessedVariables().begin(), B.getAccessedVariables().end());
+  std::vector<VariableDef*> AccessedVars(VarDefs.begin(), VarDefs.end());
+  std::sort(
+      AccessedVars.begin(),
+      AccessedVars.end(),
+      [](const auto a, const auto b)
+      { return a->getName() < b->getName(); });
+  A.setAccessedVariables(AccessedVars);
+}
+
+//==============================================================================
+// Returns the loops that were merged into the one before them
+//==============================================================================
+std::vector<unsigned> LoopFuser::fuseBlock(const ASTBlock & Stmts)
+{
+  std::vector<unsigned> Fused;
+  ForeachStmtAST* Prev = nullptr;
+
+  auto NumStmts = Stmts.size();
+  for (unsigned i=0; i<NumStmts; ++i) {
+    auto Next = dynamic_cast<ForeachStmtAST*>(Stmts[i].get());
+    if (Prev && Next && isFusable(*Prev, *Next)) {
+      fuse(*Prev, *Next);
+      Fused.emplace_back(i);
+    }
+    else {
+      Prev = Next;
+    }
+  }
+
+  return Fused;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Vizitors
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+bool LoopFuser::preVisit(ForStmtAST& e)
+{
+  auto Fused = fuseBlock(e.getBodyExprs());
+  for (auto it=Fused.rbegin(); it!=Fused.rend(); ++it) e.eraseBodyExpr(*it);
+  return false;
+}
+
+//==============================================================================
+bool LoopFuser::preVisit(IfStmtAST& e)
+{
+  auto Fused = fuseBlock(e.getThenExprs());
+  for (auto it=Fused.rbegin(); it!=Fused.rend(); ++it) e.eraseThenExpr(*it);
+
+  Fused = fuseBlock(e.getElseExprs());
+  for (auto it=Fused.rbegin(); it!=Fused.rend(); ++it) e.eraseElseExpr(*it);
+
+  return false;
+}
+
+} // namespace
@@ -0,0 +1,48 @@
+#ifndef CONTRA_FUSIONS_HPP
+#define CONTRA_FUSIONS_HPP
+
+#include "config.hpp"
+#include "recursive.hpp"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Merges back-to-back foreach loops over the same launch domain
+////////////////////////////////////////////////////////////////////////////////
+class LoopFuser : public RecursiveAstVisiter {
+
+  // what a foreach loop touches outside its body
+  struct LoopAccesses {
+    std::set<VariableDef*> Accessed;
+    std::set<VariableDef*> Written;
+    std::set<VariableDef*> Reduced;
+    std::map<std::string, VariableDef*> Partitions;
+    std::set<std::string> Locals;
+    std::set<std::string> NestedLocals;
+    bool HasSideEffects = false;
+  };
+
+  LoopAccesses getAccesses(ForeachStmtAST& e);
+  bool isSameRange(NodeAST* A, NodeAST* B);
+  bool isFusable(ForeachStmtAST& A, ForeachStmtAST& B);
+  void fuse(ForeachStmtAST& A, ForeachStmtAST& B);
+  std::vector<unsigned> fuseBlock(const ASTBlock & Stmts);
+
+public:
+
+  void runVisitor(FunctionAST&e);
+
+  bool preVisit(ForStmtAST& e) override;
+  bool preVisit(ForeachStmtAST&) override { return true; }
+  bool preVisit(IfStmtAST& e) override;
+
+};
+
+} // namespace
+
+#endif // CONTRA_FUSIONS_HPP
@@ -18,6 +18,26 @@ void FutureIdentifier::runVisitor(FunctionAST&e)
   }
 }
 
+//==============================================================================
+bool FutureIdentifier::isReady(NodeAST* Expr) const
+{
+  // checks every variable and call an expression depends on
+  struct ReadyChecker : public RecursiveAstVisiter {
+    bool IsReady = true;
+    void postVisit(VarAccessExprAST& e) override {
+      auto VarDef = e.getVariableDef();
+      if (VarDef && VarDef->getType().isFuture()) IsReady = false;
+    }
+    void postVisit(CallExprAST& e) override {
+      if (e.isFuture()) IsReady = false;
+    }
+  };
+
+  ReadyChecker Checker;
+  Expr->accept(Checker);
+  return Checker.IsReady;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Vizitors
 ////////////////////////////////////////////////////////////////////////////////
@@ -28,6 +48,17 @@ void FutureIdentifier::postVisit(CallExprAST& e)
   auto FunDef = e.getFunctionDef();
   auto IsTask = FunDef->isTask();
 
+  // small leaf tasks are called directly when nothing needs to be waited on
+  if (IsTask && FunDef->isInline() && !e.isTopLevelTask()) {
+    bool IsReady = true;
+    for (const auto & Arg : e.getArgExprs())
+      IsReady = IsReady && isReady(Arg.get());
+    if (IsReady) {
+      e.setInlined();
+      IsTask = false;
+    }
+  }
+
   auto NumArgs = e.getNumArgs();
   for (unsigned i=0; i<NumArgs; ++i) {
     auto ArgExpr = dynamic_cast<ExprAST*>(e.getArgExpr(i));
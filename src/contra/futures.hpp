@@ -17,6 +17,8 @@ class FutureIdentifier : public RecursiveAstVisiter {
 
   void addFlow(VariableDef* Left, VariableDef* Right)
   { VariableTable_[Left].emplace(Right); }
+
+  bool isReady(NodeAST* Expr) const;
   
 public:
 
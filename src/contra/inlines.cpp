@@ -0,0 +1,143 @@
+#include "args.hpp"
+#include "inlines.hpp"
+
+namespace contra {
+
+using namespace llvm;
+
+////////////////////////////////////////////////////////////////////////////////
+// Inlining args
+////////////////////////////////////////////////////////////////////////////////
+
+cl::opt<unsigned> OptionInlineThreshold(
+    "inline-threshold",
+    cl::desc("Call leaf tasks with at most this many expressions directly "
+      "(0 disables)"),
+    cl::init(16),
+    cl::cat(OptionCategory));
+
+//==============================================================================
+void InlineIdentifier::runVisitor(FunctionAST&e)
+{
+  auto FunDef = e.getFunctionDef();
+  if (!OptionInlineThreshold || !FunDef) return;
+  if (!e.isTask() || !e.isLeaf() || e.isTopLevelExpression()) return;
+
+  // only plain values go in and out
+  IsInlinable_ = true;
+  for (const auto & ArgT : FunDef->getArgTypes())
+    if (!ArgT.isNumber() || ArgT.isField() || ArgT.isPartition())
+      IsInlinable_ = false;
+  const auto & RetT = FunDef->getReturnType();
+  if (RetT && (!RetT.isNumber() || RetT.isField() || RetT.isPartition()))
+    IsInlinable_ = false;
+
+  Cost_ = 0;
+  if (IsInlinable_) e.accept(*this);
+
+  FunDef->setInline(IsInlinable_ && Cost_ <= OptionInlineThreshold);
+}
+
+//==============================================================================
+void InlineIdentifier::checkVariable(VariableDef* VarDef)
+{
+  if (!VarDef) return;
+  const auto & VarT = VarDef->getType();
+  if (!VarT.isNumber() || VarT.isField() || VarT.isPartition())
+    IsInlinable_ = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Vizitors
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+bool InlineIdentifier::preVisit(ArrayAccessExprAST&)
+{
+  IsInlinable_ = false;
+  return true;
+}
+
+//==============================================================================
+bool InlineIdentifier::preVisit(ArrayExprAST&)
+{
+  IsInlinable_ = false;
+  return true;
+}
+
+//==============================================================================
+bool InlineIdentifier::preVisit(RangeExprAST&)
+{
+  IsInlinable_ = false;
+  return true;
+}
+
+//==============================================================================
+bool InlineIdentifier::preVisit(ForStmtAST&)
+{
+  IsInlinable_ = false;
+  return true;
+}
+
+//==============================================================================
+bool InlineIdentifier::preVisit(ForeachStmtAST&)
+{
+  IsInlinable_ = false;
+  return true;
+}
+
+//==============================================================================
+bool InlineIdentifier::preVisit(PartitionStmtAST&)
+{
+  IsInlinable_ = false;
+  return true;
+}
+
+//==============================================================================
+bool InlineIdentifier::preVisit(ReductionStmtAST&)
+{
+  IsInlinable_ = false;
+  return true;
+}
+
+//==============================================================================
+void InlineIdentifier::postVisit(ValueExprAST&)
+{ Cost_++; }
+
+//==============================================================================
+void InlineIdentifier::postVisit(VarAccessExprAST& e)
+{
+  checkVariable(e.getVariableDef());
+  Cost_++;
+}
+
+//==============================================================================
+void InlineIdentifier::postVisit(CastExprAST&)
+{ Cost_++; }
+
+//==============================================================================
+void InlineIdentifier::postVisit(UnaryExprAST&)
+{ Cost_++; }
+
+//==============================================================================
+void InlineIdentifier::postVisit(BinaryExprAST&)
+{ Cost_++; }
+
+//==============================================================================
+void InlineIdentifier::postVisit(CallExprAST& e)
+{
+  // output has to happen exactly as often as the task runs
+  auto FunDef = e.getFunctionDef();
+  if (FunDef->isTask() || e.getName() == "print") IsInlinable_ = false;
+  Cost_++;
+}
+
+//==============================================================================
+void InlineIdentifier::postVisit(IfStmtAST&)
+{ Cost_++; }
+
+//==============================================================================
+void InlineIdentifier::postVisit(AssignStmtAST&)
+{ Cost_++; }
+
+} // namespace
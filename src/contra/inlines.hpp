@@ -0,0 +1,44 @@
+#ifndef CONTRA_INLINES_HPP
+#define CONTRA_INLINES_HPP
+
+#include "config.hpp"
+#include "recursive.hpp"
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Identifies small leaf tasks that can be called directly
+////////////////////////////////////////////////////////////////////////////////
+class InlineIdentifier : public RecursiveAstVisiter {
+
+  unsigned Cost_ = 0;
+  bool IsInlinable_ = false;
+
+  void checkVariable(VariableDef* VarDef);
+  
+public:
+
+  void runVisitor(FunctionAST&e);
+  
+  bool preVisit(ArrayAccessExprAST& e) override;
+  bool preVisit(ArrayExprAST& e) override;
+  bool preVisit(RangeExprAST& e) override;
+  bool preVisit(ForStmtAST& e) override;
+  bool preVisit(ForeachStmtAST& e) override;
+  bool preVisit(PartitionStmtAST& e) override;
+  bool preVisit(ReductionStmtAST& e) override;
+
+  void postVisit(ValueExprAST& e) override;
+  void postVisit(VarAccessExprAST& e) override;
+  void postVisit(CastExprAST& e) override;
+  void postVisit(UnaryExprAST& e) override;
+  void postVisit(BinaryExprAST& e) override;
+  void postVisit(CallExprAST& e) override;
+  void postVisit(IfStmtAST& e) override;
+  void postVisit(AssignStmtAST& e) override;
+
+};
+
+} // namespace
+
+#endif // CONTRA_INLINES_HPP
@@ -10,8 +10,10 @@ namespace contra {
 void LeafIdentifier::postVisit(CallExprAST& e)
 {
   auto FunDef = e.getFunctionDef();
-  auto IsTask = FunDef->isTask();
+  auto IsTask = FunDef->isTask() && !e.isInlined();
   if (IsTask) CallsTask_ = true;
+  // timers fence outstanding work, which leaf tasks may not do
+  if (e.getName() == "timer") CallsTask_ = true;
 }
 
 //==============================================================================
@@ -4,6 +4,7 @@
 #include "codegen.hpp"
 #include "errors.hpp"
 #include "legion.hpp"
+#include "legion_mapper.hpp"
 #include "legion_rt.hpp"
 
 #include "utils/llvm_utils.hpp"
@@ -27,6 +28,16 @@ cl::opt<std::string> OptionLegion(
     cl::desc("Legion runtime options"),
     cl::cat(OptionCategory));
 
+cl::opt<bool> OptionLegionReplicate(
+    "legion-replicate",
+    cl::desc("Run the top-level task with control replication"),
+    cl::cat(OptionCategory));
+
+cl::opt<bool> OptionLegionTrace(
+    "legion-trace",
+    cl::desc("Trace loops that repeat the same task launches"),
+    cl::cat(OptionCategory));
+
 ////////////////////////////////////////////////////////////////////////////////
 // Legion tasker
 ////////////////////////////////////////////////////////////////////////////////
@@ -524,6 +535,7 @@ void LegionTasker::destroyPartitionInfo(
 //==============================================================================
 void LegionTasker::createFieldArguments(
     llvm::Module & TheModule,
+    const TaskInfo & TaskI,
     Value* LauncherA,
     const std::vector<Value*> & ArgVorAs,
     const std::vector<Value*> & PartVorAs,
@@ -531,6 +543,13 @@ void LegionTasker::createFieldArguments(
     Value* PartInfoA )
 {
   auto NumArgs = ArgVorAs.size();
+
+  // fields a task never writes only need to be read
+  auto getPrivilege = [&](unsigned i) {
+    legion_privilege_mode_t Priv = READ_WRITE;
+    if (!isWrite(TaskI.getArgAccess(i))) Priv = READ_ONLY;
+    return llvmValue(TheContext_, Int32Type_, Priv);
+  };
   
   //----------------------------------------------------------------------------
   // Add region requirements
@@ -547,7 +566,9 @@ void LegionTasker::createFieldArguments(
       IndexSpaceA->getType(),
       VoidPtrType_->getPointerTo(),
       IndexPartitionType_->getPointerTo(),
-      FieldDataType_->getPointerTo()
+      FieldDataType_->getPointerTo(),
+      Int32Type_,
+      Int32Type_
     };
 
     auto FunF = TheHelper_.createFunction(
@@ -562,6 +583,12 @@ void LegionTasker::createFieldArguments(
       FieldA = TheHelper_.getAsAlloca(FieldA);
       Value* PartA = Constant::getNullValue(IndexPartitionType_->getPointerTo());
       if (PartVorAs[i]) PartA =TheHelper_.getAsAlloca(PartVorAs[i]);
+      // zero is never a valid reduction op
+      legion_reduction_op_id_t RedopId = 0;
+      if (auto Reduction = TaskI.getArgReduction(i)) {
+        auto Redop = dynamic_cast<const LegionReduceInfo*>(Reduction->Redop.get());
+        RedopId = Redop->getId();
+      }
       std::vector<Value*> FunArgVs = {
         RuntimeA,
         ContextA,
@@ -569,7 +596,9 @@ void LegionTasker::createFieldArguments(
         IndexSpaceA,
         PartInfoA,
         PartA,
-        FieldA
+        FieldA,
+        getPrivilege(i),
+        llvmValue<legion_reduction_op_id_t>(TheContext_, RedopId)
       };
       Builder_.CreateCall(FunF, FunArgVs);
     }
@@ -581,7 +610,8 @@ void LegionTasker::createFieldArguments(
 
     std::vector<Type*> FunArgTs = {
       LauncherRT,
-      FieldDataType_->getPointerTo() };
+      FieldDataType_->getPointerTo(),
+      Int32Type_ };
 
     auto FunF = TheHelper_.createFunction(
         TheModule,
@@ -593,7 +623,7 @@ void LegionTasker::createFieldArguments(
       auto FieldV = ArgVorAs[i];
       if (!isField(FieldV)) continue;
       FieldV = TheHelper_.getAsAlloca(FieldV); 
-      std::vector<Value*> FunArgVs = {LauncherA, FieldV};
+      std::vector<Value*> FunArgVs = {LauncherA, FieldV, getPrivilege(i)};
       Builder_.CreateCall(FunF, FunArgVs);
     }
   }
@@ -701,6 +731,12 @@ void LegionTasker::createRegistrationArguments(
     auto TrueV = llvmValue(TheContext_, BoolT, 1);
     TheHelper_.insertValue(TaskConfigA, TrueV, 0);
   }
+  // only the top-level task is replicated by the mapper, but any inner task
+  // may end up as the top-level one
+  else if (OptionLegionReplicate) {
+    auto TrueV = llvmValue(TheContext_, BoolT, 1);
+    TheHelper_.insertValue(TaskConfigA, TrueV, 3);
+  }
 
 }
 
@@ -1260,6 +1296,8 @@ void LegionTasker::postregisterTask(
   //----------------------------------------------------------------------------
   // Register reduction
   if (Task.hasReduction()) registerReductionOp(TheModule, Task.getReduction());
+  for (const auto & Reduction : Task.getArgReductions())
+    registerReductionOp(TheModule, Reduction.second.Redop.get());
 }
 
 //==============================================================================
@@ -1320,6 +1358,8 @@ void LegionTasker::preregisterTask(
   //----------------------------------------------------------------------------
   // Register reduction
   if (Task.hasReduction()) registerReductionOp(TheModule, Task.getReduction());
+  for (const auto & Reduction : Task.getArgReductions())
+    registerReductionOp(TheModule, Reduction.second.Redop.get());
 }
   
 //==============================================================================
@@ -1362,6 +1402,11 @@ void LegionTasker::startRuntime(Module &TheModule)
     Argv.emplace_back("-ll:gsize");
     Argv.emplace_back("0");
   }
+
+  if (OptionLegionReplicate) {
+    Argv.emplace_back("-dm:replicate");
+    Argv.emplace_back("1");
+  }
   
   // startup runtime
   TheHelper_.callFunction(
@@ -1413,7 +1458,7 @@ Value* LegionTasker::launch(
   // Launch
 
   auto TaskId = TaskI.getId();
-  auto MapperIdV = llvmValue(TheContext_, MapperIdType_, 0); 
+  auto MapperIdV = llvmValue(TheContext_, MapperIdType_, ContraMapperId);
   auto MappingTagIdV = llvmValue(TheContext_, MappingTagIdType_, 0); 
   auto PredicateV = load(PredicateA, TheModule, "predicate");
   auto TaskIdV = llvmValue(TheContext_, TaskIdType_, TaskId);
@@ -1440,7 +1485,7 @@ Value* LegionTasker::launch(
   
   //----------------------------------------------------------------------------
   // Add fields
-  createFieldArguments(TheModule, LauncherA, ArgVs );
+  createFieldArguments(TheModule, TaskI, LauncherA, ArgVs );
 
   
   //----------------------------------------------------------------------------
@@ -1478,6 +1523,138 @@ Value* LegionTasker::launch(
   return FutureA;
 }
 
+//==============================================================================
+// Only let the first shard through
+//==============================================================================
+void LegionTasker::pushRootGuard(Module & TheModule)
+{
+  if (!OptionLegionReplicate) return;
+
+  // outside of any task there is nothing to guard
+  if (TaskAllocas_.empty()) {
+    RootGuards_.push_front({});
+    return;
+  }
+
+  const auto & LegionE = getCurrentTask();
+  const auto & ContextA = LegionE.ContextAlloca;
+  const auto & RuntimeA = LegionE.RuntimeAlloca;
+
+  auto TestV = TheHelper_.callFunction(
+      TheModule,
+      "contra_legion_test_root",
+      BoolType_,
+      {RuntimeA, ContextA});
+  auto CondV = TheHelper_.createCast(TestV, Int1Type_);
+
+  auto TheFunction = Builder_.GetInsertBlock()->getParent();
+  auto ThenBB = BasicBlock::Create(TheContext_, "then", TheFunction);
+  auto MergeBB = BasicBlock::Create(TheContext_, "ifcont");
+  Builder_.CreateCondBr(CondV, ThenBB, MergeBB);
+  Builder_.SetInsertPoint(ThenBB);
+
+  RootGuards_.push_front({MergeBB});
+}
+
+//==============================================================================
+// Pop the root guard
+//==============================================================================
+void LegionTasker::popRootGuard(Module&)
+{
+  if (!OptionLegionReplicate) return;
+
+  auto MergeBB = RootGuards_.front().MergeBlock;
+  RootGuards_.pop_front();
+  if (!MergeBB) return;
+
+  auto TheFunction = Builder_.GetInsertBlock()->getParent();
+  Builder_.CreateBr(MergeBB);
+  TheFunction->getBasicBlockList().push_back(MergeBB);
+  Builder_.SetInsertPoint(MergeBB);
+}
+
+//==============================================================================
+// Wait for all issued work
+//==============================================================================
+void LegionTasker::fence(Module & TheModule)
+{
+  // tasks that read a timer are never registered as leaf tasks
+  if (TaskAllocas_.empty()) return;
+
+  const auto & LegionE = getCurrentTask();
+  const auto & ContextA = LegionE.ContextAlloca;
+  const auto & RuntimeA = LegionE.RuntimeAlloca;
+
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_legion_fence",
+      VoidType_,
+      {RuntimeA, ContextA});
+}
+
+//==============================================================================
+// Create a trace for a loop
+//==============================================================================
+AllocaInst* LegionTasker::createTrace(Module &)
+{
+  if (!OptionLegionTrace) return nullptr;
+
+  // the iteration counter is stored next to the trace id
+  auto IntT = llvmType<int_t>(TheContext_);
+  auto TraceIdT = llvmType<legion_trace_id_t>(TheContext_);
+  if (!TraceType_)
+    TraceType_ = StructType::create(
+        TheContext_,
+        {TraceIdT, IntT},
+        "contra_legion_trace_t");
+  auto TraceA = TheHelper_.createEntryBlockAlloca(TraceType_, "trace");
+
+  auto TraceIdV = llvmValue(TheContext_, TraceIdT, TraceCounter_++);
+  auto ZeroC = llvmValue(TheContext_, IntT, 0);
+  TheHelper_.insertValue(TraceA, TraceIdV, 0);
+  TheHelper_.insertValue(TraceA, ZeroC, 1);
+
+  return TraceA;
+}
+
+//==============================================================================
+// Begin a trace
+//==============================================================================
+void LegionTasker::beginTrace(Module &TheModule, AllocaInst* TraceA)
+{
+  const auto & LegionE = getCurrentTask();
+  const auto & ContextA = LegionE.ContextAlloca;
+  const auto & RuntimeA = LegionE.RuntimeAlloca;
+
+  auto TraceIdV = TheHelper_.extractValue(TraceA, 0);
+  auto IterA = TheHelper_.getElementPointer(TraceA, 0, 1);
+
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_legion_trace_begin",
+      VoidType_,
+      {RuntimeA, ContextA, TraceIdV, IterA});
+}
+
+//==============================================================================
+// End a trace
+//==============================================================================
+void LegionTasker::endTrace(Module &TheModule, AllocaInst* TraceA)
+{
+  const auto & LegionE = getCurrentTask();
+  const auto & ContextA = LegionE.ContextAlloca;
+  const auto & RuntimeA = LegionE.RuntimeAlloca;
+
+  auto TraceIdV = TheHelper_.extractValue(TraceA, 0);
+  auto IterA = TheHelper_.getElementPointer(TraceA, 0, 1);
+
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_legion_trace_end",
+      VoidType_,
+      {RuntimeA, ContextA, TraceIdV, IterA});
+}
+
 //==============================================================================
 // Launch an index task
 //==============================================================================
@@ -1578,7 +1755,7 @@ Value* LegionTasker::launch(
   // Launch
  
   auto TaskId = TaskI.getId();
-  auto MapperIdV = llvmValue(TheContext_, MapperIdType_, 0); 
+  auto MapperIdV = llvmValue(TheContext_, MapperIdType_, ContraMapperId);
   auto MappingTagIdV = llvmValue(TheContext_, MappingTagIdType_, 0); 
   auto PredicateV = load(PredicateA, TheModule, "predicate");
   auto TaskIdV = llvmValue(TheContext_, TaskIdType_, TaskId);
@@ -1616,6 +1793,7 @@ Value* LegionTasker::launch(
   // Add fields
   createFieldArguments(
       TheModule,
+      TaskI,
       LauncherA,
       ArgAs,
       PartAs,
@@ -2054,6 +2232,38 @@ AllocaInst* LegionTasker::createPartition(
 
 }
 
+//==============================================================================
+// create a block partition
+//==============================================================================
+AllocaInst* LegionTasker::createBlockPartition(
+    Module & TheModule,
+    Value* IndexSpaceA,
+    Value* DimsA,
+    Value* BlocksA)
+{
+  auto & LegionE = getCurrentTask();
+  const auto & ContextA = LegionE.ContextAlloca;
+  const auto & RuntimeA = LegionE.RuntimeAlloca;
+
+  auto IndexPartA = TheHelper_.createEntryBlockAlloca(IndexPartitionType_);
+
+  std::vector<Value*> FunArgVs = {
+    RuntimeA,
+    ContextA,
+    TheHelper_.getAsAlloca(DimsA),
+    TheHelper_.getAsAlloca(BlocksA),
+    TheHelper_.getAsAlloca(IndexSpaceA),
+    IndexPartA};
+  
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_legion_index_space_partition_from_blocks",
+      VoidType_,
+      FunArgVs);
+
+  return IndexPartA;
+}
+
 
 //==============================================================================
 // destroey a field
@@ -2144,63 +2354,60 @@ bool LegionTasker::isAccessor(Value* AccessorA) const
   return isAccessor(AccessorT);
 }
 
+//==============================================================================
+// Get a pointer to an accessor element
+//==============================================================================
+Value* LegionTasker::getAccessorPointer(
+    Type* ValueT,
+    Value* AccessorV,
+    Value* IndexV) const
+{
+  auto AccessorA = TheHelper_.getAsAlloca(AccessorV);
+
+  // raw pointer to the first element and its affine stride in bytes
+  auto DataV = TheHelper_.extractValue(AccessorA, 8);
+  auto OffsetsGEP = TheHelper_.getElementPointer(
+      AccessorA, std::vector<unsigned>{0, 6, 0});
+  auto StrideV = TheHelper_.load(OffsetsGEP);
+
+  auto IntT = llvmType<int_t>(TheContext_);
+  StrideV = Builder_.CreateSExt(StrideV, IntT);
+
+  Value* OffsetV = IndexV ?
+    Builder_.CreateMul(TheHelper_.getAsValue(IndexV), StrideV) :
+    llvmValue<int_t>(TheContext_, 0);
+
+  auto BytePtrV = TheHelper_.createBitCast(DataV, CharType_->getPointerTo());
+  auto ElemPtrV = Builder_.CreateGEP(BytePtrV, OffsetV);
+  return TheHelper_.createBitCast(ElemPtrV, ValueT->getPointerTo());
+}
+
 //==============================================================================
 // Store a value into an accessor
 //==============================================================================
 void LegionTasker::storeAccessor(
-    Module & TheModule,
+    Module &,
     Value* ValueV,
     Value* AccessorV,
     Value* IndexV) const
 {
-  auto ValueA = TheHelper_.getAsAlloca(ValueV);
-
-  Value* AccessorA = TheHelper_.getAsAlloca(AccessorV);
-    
-  std::vector<Value*> FunArgVs = { AccessorA, ValueA };
-  
-  if (IndexV) {
-    FunArgVs.emplace_back( TheHelper_.getAsValue(IndexV) );
-  }
-  else {
-    FunArgVs.emplace_back( llvmValue<int_t>(TheContext_, 0) );
-  }
-  
-  TheHelper_.callFunction(
-      TheModule,
-      "contra_legion_accessor_write",
-      VoidType_,
-      FunArgVs);
+  auto ValueT = TheHelper_.getAsValue(ValueV)->getType();
+  auto PtrV = getAccessorPointer(ValueT, AccessorV, IndexV);
+  Builder_.CreateStore(TheHelper_.getAsValue(ValueV), PtrV);
 }
 
 //==============================================================================
 // Load a value from an accessor
 //==============================================================================
 Value* LegionTasker::loadAccessor(
-    Module & TheModule, 
+    Module &, 
     Type * ValueT,
     Value* AccessorV,
     Value* IndexV) const
 {
-  auto AccessorA = TheHelper_.getAsAlloca(AccessorV);
-    
+  auto PtrV = getAccessorPointer(ValueT, AccessorV, IndexV);
   auto ValueA = TheHelper_.createEntryBlockAlloca(ValueT);
-
-  std::vector<Value*> FunArgVs = { AccessorA, ValueA };
-  
-  if (IndexV) {
-    FunArgVs.emplace_back( TheHelper_.getAsValue(IndexV) );
-  }
-  else {
-    FunArgVs.emplace_back( llvmValue<int_t>(TheContext_, 0) );
-  }
-
-  TheHelper_.callFunction(
-      TheModule,
-      "contra_legion_accessor_read",
-      VoidType_,
-      FunArgVs);
-
+  Builder_.CreateStore(Builder_.CreateLoad(ValueT, PtrV), ValueA);
   return ValueA;
 }
 
@@ -116,6 +116,7 @@ protected:
   llvm::StructType* FieldDataType_ = nullptr;
   llvm::StructType* AccessorDataType_ = nullptr;
   llvm::StructType* PartitionDataType_ = nullptr;
+  llvm::StructType* TraceType_ = nullptr;
 
   struct TaskEntry {
     llvm::AllocaInst* ContextAlloca = nullptr;
@@ -126,6 +127,14 @@ protected:
 
   std::forward_list<TaskEntry> TaskAllocas_;
 
+  unsigned TraceCounter_ = 0;
+
+  struct RootGuard {
+    llvm::BasicBlock * MergeBlock = nullptr;
+  };
+
+  std::forward_list<RootGuard> RootGuards_;
+
   enum class ArgType : char {
     None = 0,
     Future,
@@ -168,6 +177,14 @@ public:
   
   virtual void startRuntime(llvm::Module &) override;
   
+  virtual void pushRootGuard(llvm::Module&) override;
+  virtual void popRootGuard(llvm::Module&) override;
+  virtual void fence(llvm::Module&) override;
+  
+  virtual llvm::AllocaInst* createTrace(llvm::Module &) override;
+  virtual void beginTrace(llvm::Module &, llvm::AllocaInst*) override;
+  virtual void endTrace(llvm::Module &, llvm::AllocaInst*) override;
+  
   virtual llvm::Value* launch(
       llvm::Module &,
       const TaskInfo &,
@@ -261,6 +278,11 @@ public:
       llvm::Module &,
       llvm::Value*,
       llvm::Value*) override;
+  virtual llvm::AllocaInst* createBlockPartition(
+      llvm::Module &,
+      llvm::Value*,
+      llvm::Value*,
+      llvm::Value*) override;
   
   virtual bool isPartition(llvm::Type*) const override;
   virtual bool isPartition(llvm::Value*) const override;
@@ -276,6 +298,8 @@ public:
       const std::vector<llvm::Type*> &,
       const std::vector<ReductionType> &) override;
 
+  virtual bool needsArgReductionOps() const override { return true; }
+
   virtual ~LegionTasker() = default;
 
 protected:
@@ -321,8 +345,14 @@ protected:
     const std::vector<llvm::Value*> &,
     bool IsIndex);
   
+  llvm::Value* getAccessorPointer(
+      llvm::Type*,
+      llvm::Value*,
+      llvm::Value*) const;
+
   void createFieldArguments(
     llvm::Module &,
+    const TaskInfo &,
     llvm::Value*,
     const std::vector<llvm::Value*> &,
     const std::vector<llvm::Value*> & = {},
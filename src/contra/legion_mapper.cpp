@@ -0,0 +1,165 @@
+#include "legion_mapper.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+using namespace Legion;
+using namespace Legion::Mapping;
+
+namespace contra {
+
+//==============================================================================
+// Constructor
+//==============================================================================
+ContraMapper::ContraMapper(
+    MapperRuntime *rt,
+    Machine machine,
+    Processor local) :
+  DefaultMapper(rt, machine, local, "contra_mapper")
+{
+  unsigned MaxCpus = 0;
+  parseArgs(MaxCpus);
+
+  // gather the cpus of every node, interleaving the nodes so that
+  // consecutive points land on different nodes
+  std::map<AddressSpace, std::vector<Processor>> NodeCpus;
+  Machine::ProcessorQuery Query(machine);
+  Query.only_kind(Processor::LOC_PROC);
+  for (auto Proc : Query) {
+    auto & Cpus = NodeCpus[Proc.address_space()];
+    if (!MaxCpus || Cpus.size() < MaxCpus) Cpus.emplace_back(Proc);
+  }
+
+  for (unsigned i=0; ; ++i) {
+    bool Found = false;
+    for (const auto & Node : NodeCpus) {
+      if (i < Node.second.size()) {
+        Cpus_.emplace_back(Node.second[i]);
+        Found = true;
+      }
+    }
+    if (!Found) break;
+  }
+}
+
+//==============================================================================
+// Parse the mapper options
+//==============================================================================
+void ContraMapper::parseArgs(unsigned & MaxCpus)
+{
+  const auto & Args = Runtime::get_input_args();
+  for (int i=1; i<Args.argc; ++i) {
+    if (!strcmp(Args.argv[i], "-cm:blocked"))
+      IsBlocked_ = true;
+    else if (!strcmp(Args.argv[i], "-cm:aos"))
+      IsAos_ = true;
+    else if (!strcmp(Args.argv[i], "-cm:no-reuse"))
+      IsReused_ = false;
+    else if (!strcmp(Args.argv[i], "-cm:cpus") && i+1<Args.argc)
+      MaxCpus = std::atoi(Args.argv[++i]);
+  }
+}
+
+//==============================================================================
+// Spread index launches over the cpus
+//==============================================================================
+void ContraMapper::slice_task(
+    const MapperContext ctx,
+    const Task& task,
+    const SliceTaskInput& input,
+    SliceTaskOutput& output)
+{
+  if (Cpus_.empty() || input.domain.get_dim() != 1) {
+    DefaultMapper::slice_task(ctx, task, input, output);
+    return;
+  }
+
+  Rect<1> Bounds = input.domain;
+  auto NumPoints = Bounds.volume();
+  auto NumCpus = Cpus_.size();
+
+  // contiguous blocks of points
+  if (IsBlocked_) {
+    auto Chunk = NumPoints / NumCpus;
+    auto Rem = NumPoints % NumCpus;
+    auto Lo = Bounds.lo[0];
+    for (size_t i=0; i<NumCpus && Lo<=Bounds.hi[0]; ++i) {
+      coord_t Size = Chunk + (i<Rem ? 1 : 0);
+      if (!Size) break;
+      Rect<1> Slice(Lo, Lo+Size-1);
+      output.slices.emplace_back(Slice, Cpus_[i], false, false);
+      Lo += Size;
+    }
+  }
+  // round robin
+  else {
+    for (coord_t p=Bounds.lo[0]; p<=Bounds.hi[0]; ++p) {
+      const auto & Proc = Cpus_[(p - Bounds.lo[0]) % NumCpus];
+      output.slices.emplace_back(Rect<1>(p, p), Proc, false, false);
+    }
+  }
+}
+
+//==============================================================================
+// Select the instance layout
+//==============================================================================
+void ContraMapper::default_policy_select_constraints(
+    MapperContext ctx,
+    LayoutConstraintSet &constraints,
+    Memory target_memory,
+    const RegionRequirement &req)
+{
+  DefaultMapper::default_policy_select_constraints(
+      ctx, constraints, target_memory, req);
+
+  auto NumDims = req.region.get_index_space().get_dim();
+  std::vector<DimensionKind> Ordering;
+  if (IsAos_) Ordering.emplace_back(LEGION_DIM_F);
+  for (int i=0; i<NumDims; ++i)
+    Ordering.emplace_back(static_cast<DimensionKind>(LEGION_DIM_X + i));
+  if (!IsAos_) Ordering.emplace_back(LEGION_DIM_F);
+  constraints.ordering_constraint = OrderingConstraint(Ordering, false);
+}
+
+//==============================================================================
+// Select the region an instance covers
+//==============================================================================
+LogicalRegion ContraMapper::default_policy_select_instance_region(
+    MapperContext ctx,
+    Memory target_memory,
+    const RegionRequirement &req,
+    const LayoutConstraintSet &constraints,
+    bool force_new_instances,
+    bool meets_constraints)
+{
+  if (!IsReused_ || force_new_instances || !meets_constraints)
+    return req.region;
+  if (req.privilege == LEGION_REDUCE) return req.region;
+  if (total_nodes > 1) return req.region;
+
+  // on a single node, one instance of the whole field is shared by every
+  // launch, no matter how it was partitioned
+  auto Region = req.region;
+  while (runtime->has_parent_logical_partition(ctx, Region)) {
+    auto Part = runtime->get_parent_logical_partition(ctx, Region);
+    Region = runtime->get_parent_logical_region(ctx, Part);
+  }
+  return Region;
+}
+
+//==============================================================================
+// Register the mapper
+//==============================================================================
+void contra_legion_register_mapper(
+    Machine machine,
+    Runtime *runtime,
+    const std::set<Processor> &local_procs)
+{
+  for (auto Proc : local_procs) {
+    auto Mapper = new ContraMapper(runtime->get_mapper_runtime(), machine, Proc);
+    runtime->add_mapper(ContraMapperId, Mapper, Proc);
+  }
+}
+
+} // namespace
@@ -0,0 +1,72 @@
+#ifndef CONTRA_LEGION_MAPPER_HPP
+#define CONTRA_LEGION_MAPPER_HPP
+
+#include <legion.h>
+#include <mappers/default_mapper.h>
+
+#include <set>
+#include <vector>
+
+namespace contra {
+
+/// the mapper id used for all contra launches
+constexpr Legion::MapperID ContraMapperId = 1;
+
+////////////////////////////////////////////////////////////////////////////////
+/// Mapper for CPU-only nodes
+///
+/// Options are read from the legion arguments:
+///   -cm:blocked      give each cpu a contiguous block of index points
+///   -cm:cpus <n>     only use the first n cpus of each node
+///   -cm:aos          lay field instances out as arrays of structures
+///   -cm:no-reuse     size instances to the mapped region only
+////////////////////////////////////////////////////////////////////////////////
+class ContraMapper : public Legion::Mapping::DefaultMapper {
+
+  std::vector<Legion::Processor> Cpus_;
+
+  bool IsBlocked_ = false;
+  bool IsAos_ = false;
+  bool IsReused_ = true;
+
+public:
+
+  ContraMapper(
+      Legion::Mapping::MapperRuntime *rt,
+      Legion::Machine machine,
+      Legion::Processor local);
+
+  virtual void slice_task(
+      const Legion::Mapping::MapperContext ctx,
+      const Legion::Task& task,
+      const SliceTaskInput& input,
+      SliceTaskOutput& output) override;
+
+protected:
+
+  virtual void default_policy_select_constraints(
+      Legion::Mapping::MapperContext ctx,
+      Legion::LayoutConstraintSet &constraints,
+      Legion::Memory target_memory,
+      const Legion::RegionRequirement &req) override;
+
+  virtual Legion::LogicalRegion default_policy_select_instance_region(
+      Legion::Mapping::MapperContext ctx,
+      Legion::Memory target_memory,
+      const Legion::RegionRequirement &req,
+      const Legion::LayoutConstraintSet &constraints,
+      bool force_new_instances,
+      bool meets_constraints) override;
+
+  void parseArgs(unsigned & MaxCpus);
+};
+
+/// register the mapper with every local processor
+void contra_legion_register_mapper(
+    Legion::Machine machine,
+    Legion::Runtime *runtime,
+    const std::set<Legion::Processor> &local_procs);
+
+} // namespace
+
+#endif // CONTRA_LEGION_MAPPER_HPP
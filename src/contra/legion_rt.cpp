@@ -1,5 +1,39 @@
+#include "blocks_rt.hpp"
+#include "legion_mapper.hpp"
 #include "legion_rt.hpp"
 
+#include <algorithm>
+#include <mutex>
+#include <unordered_set>
+
+namespace {
+
+//==============================================================================
+// Partitions built from fields or blocks, which tasks may not write through
+//==============================================================================
+std::mutex IndexedPartitionsMutex;
+std::unordered_set<legion_index_partition_id_t> IndexedPartitions;
+
+void registerIndexedPartition(legion_index_partition_t * part)
+{
+  std::lock_guard<std::mutex> Lock(IndexedPartitionsMutex);
+  IndexedPartitions.emplace(part->id);
+}
+
+void releaseIndexedPartition(legion_index_partition_t * part)
+{
+  std::lock_guard<std::mutex> Lock(IndexedPartitionsMutex);
+  IndexedPartitions.erase(part->id);
+}
+
+bool isIndexedPartition(legion_index_partition_t * part)
+{
+  std::lock_guard<std::mutex> Lock(IndexedPartitionsMutex);
+  return IndexedPartitions.count(part->id);
+}
+
+} // namespace
+
 extern "C" {
   
 //==============================================================================
@@ -68,7 +102,11 @@ legion_logical_partition_t*
 //==============================================================================
 // Additional startup operations
 //==============================================================================
-void contra_legion_startup() {}
+void contra_legion_startup()
+{
+  Legion::Runtime::add_registration_callback(
+      contra::contra_legion_register_mapper);
+}
 
 //==============================================================================
 /// index space creation
@@ -215,8 +253,114 @@ void contra_legion_index_space_partition_from_field(
       color_space,
       /* part_kind */ COMPUTE_KIND,
       /* color */ AUTO_GENERATE_ID,
-      /* mapper_id */ 0,
+      /* mapper_id */ contra::ContraMapperId,
       /* mapping_tag_id */ 0);
+
+  registerIndexedPartition(part);
+}
+
+//==============================================================================
+/// block partition of a row-major index space
+//==============================================================================
+void contra_legion_index_space_partition_from_blocks(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx,
+    dopevector_t * dims_arr,
+    dopevector_t * blocks_arr,
+    contra_legion_index_space_t * is,
+    legion_index_partition_t * part)
+{
+  int_t num_parts;
+  int_t * indices;
+  int_t * offsets;
+  auto index_size = is->end - is->start;
+  contra::blockPartition(
+      static_cast<const int_t*>(dims_arr->data),
+      dims_arr->size,
+      static_cast<const int_t*>(blocks_arr->data),
+      blocks_arr->size,
+      index_size,
+      num_parts,
+      indices,
+      offsets);
+
+  // the indices are stored in a field split along the blocks
+  contra_legion_index_space_t idx_is;
+  contra_legion_index_space_create(runtime, ctx, "blocks", 0, index_size-1, &idx_is);
+
+  contra_legion_field_t idx_fld;
+  contra_legion_field_create(runtime, ctx, "blocks", sizeof(int_t), nullptr,
+      &idx_is, &idx_fld);
+
+  if (index_size) {
+    auto launcher = legion_inline_launcher_create_logical_region(
+        idx_fld.logical_region,
+        WRITE_DISCARD, EXCLUSIVE,
+        idx_fld.logical_region,
+        /* legion_mapping_tag_id_t */ 0,
+        /* bool verified */ false,
+        /* mapper_id */ 0,
+        /* legion_mapping_tag_id_t */ 0);
+    legion_inline_launcher_add_field(launcher, idx_fld.field_id, /* bool inst */ true);
+    auto region = legion_inline_launcher_execute(*runtime, *ctx, launcher);
+    legion_physical_region_wait_until_valid(region);
+
+    auto accessor = legion_physical_region_get_field_accessor_array_1d(
+        region, idx_fld.field_id);
+    legion_rect_1d_t rect{ {0}, {index_size-1} };
+    legion_rect_1d_t subrect;
+    legion_byte_offset_t offs;
+    auto data = legion_accessor_array_1d_raw_rect_ptr(
+        accessor, rect, &subrect, &offs);
+    std::copy(indices, indices+index_size, static_cast<int_t*>(data));
+
+    legion_accessor_array_1d_destroy(accessor);
+    legion_runtime_unmap_region(*runtime, *ctx, region);
+    legion_physical_region_destroy(region);
+    legion_inline_launcher_destroy(launcher);
+  }
+  delete[] indices;
+
+  legion_coloring_t coloring = legion_coloring_create();
+  for (int_t p=0; p<num_parts; ++p) {
+    legion_ptr_t lo{ offsets[p] };
+    legion_ptr_t hi{ offsets[p+1] - 1 };
+    legion_coloring_add_range(coloring, p, lo, hi);
+  }
+  delete[] offsets;
+
+  auto idx_part = legion_index_partition_create_coloring(
+      *runtime,
+      *ctx,
+      idx_is.index_space,
+      coloring,
+      true,
+      /*part color*/ AUTO_GENERATE_ID );
+  legion_coloring_destroy(coloring);
+
+  // the image of the index field gives the blocks
+  contra_legion_partitions_t idx_parts;
+  auto idx_parts_ptr = &idx_parts;
+  auto res = idx_parts.getOrCreateLogicalPartition(
+      runtime, ctx, idx_fld.field_id, idx_part.id);
+  *res.first = legion_logical_partition_create(
+      *runtime,
+      *ctx,
+      idx_fld.logical_region,
+      idx_part);
+
+  contra_legion_index_space_partition_from_field(
+      runtime,
+      ctx,
+      &idx_fld,
+      is,
+      &idx_part,
+      &idx_parts_ptr,
+      part);
+
+  // legion defers these until the image is computed
+  contra_legion_field_destroy(runtime, ctx, &idx_fld);
+  contra_legion_index_space_destroy(runtime, ctx, &idx_is);
 }
 
 
@@ -387,7 +531,9 @@ void contra_legion_index_add_region_requirement(
     contra_legion_index_space_t * cs,
     contra_legion_partitions_t ** parts,
     legion_index_partition_t * specified_part,
-    contra_legion_field_t * field)
+    contra_legion_field_t * field,
+    legion_privilege_mode_t privilege,
+    legion_reduction_op_id_t redop)
 {
   legion_index_partition_t * index_part = nullptr;
 
@@ -428,17 +574,37 @@ void contra_legion_index_add_region_requirement(
         *index_part);
   }
 
-  legion_privilege_mode_t priviledge = READ_WRITE;
-  if (!legion_index_partition_is_disjoint(*runtime, *index_part))
-    priviledge = READ_ONLY;
+  // points reducing into the same entries are folded together by legion
+  unsigned idx = 0;
+  if (redop) {
+    idx = legion_index_launcher_add_region_requirement_logical_partition_reduction(
+      *launcher, *logical_part,
+      /* legion_projection_id_t */ 0,
+      redop, EXCLUSIVE,
+      field->logical_region,
+      /* legion_mapping_tag_id_t */ 0,
+      /* bool verified */ false);
+  }
+  else {
+    if (privilege != READ_ONLY && specified_part &&
+        isIndexedPartition(specified_part))
+    {
+      legion_runtime_print_once(*runtime, *ctx, stderr,
+          "Tasks can not write to fields through partitions built from "
+          "fields or blocks.\n");
+      abort();
+    }
+    if (!legion_index_partition_is_disjoint(*runtime, *index_part))
+      privilege = READ_ONLY;
 
-  unsigned idx = legion_index_launcher_add_region_requirement_logical_partition(
-    *launcher, *logical_part,
-    /* legion_projection_id_t */ 0,
-    priviledge, EXCLUSIVE,
-    field->logical_region,
-    /* legion_mapping_tag_id_t */ 0,
-    /* bool verified */ false);
+    idx = legion_index_launcher_add_region_requirement_logical_partition(
+      *launcher, *logical_part,
+      /* legion_projection_id_t */ 0,
+      privilege, EXCLUSIVE,
+      field->logical_region,
+      /* legion_mapping_tag_id_t */ 0,
+      /* bool verified */ false);
+  }
 
   legion_index_launcher_add_field(*launcher, idx, field->field_id, /* bool inst */ true);
 }
@@ -448,11 +614,12 @@ void contra_legion_index_add_region_requirement(
 //==============================================================================
 void contra_legion_task_add_region_requirement(
     legion_task_launcher_t * launcher,
-    contra_legion_field_t * field )
+    contra_legion_field_t * field,
+    legion_privilege_mode_t privilege)
 {
   unsigned idx = legion_task_launcher_add_region_requirement_logical_region(
     *launcher, field->logical_region,
-    READ_WRITE, EXCLUSIVE,
+    privilege, EXCLUSIVE,
     field->logical_region,
     /* legion_mapping_tag_id_t */ 0,
     /* bool verified */ false);
@@ -540,30 +707,6 @@ void contra_legion_get_accessor(
 }
 
 
-//==============================================================================
-/// Accessor write
-//==============================================================================
-void contra_legion_accessor_write(
-    contra_legion_accessor_t * acc,
-    const void * data,
-    int_t index)
-{
-  byte_t * offset = static_cast<byte_t*>(acc->data) + acc->data_size*index;
-  memcpy(offset, data, acc->data_size);
-}
-
-//==============================================================================
-/// Accessor read
-//==============================================================================
-void contra_legion_accessor_read(
-    contra_legion_accessor_t * acc,
-    void * data,
-    int_t index)
-{
-  const byte_t * offset = static_cast<const byte_t*>(acc->data) + acc->data_size*index;
-  memcpy(data, offset, acc->data_size);
-}
-
 //==============================================================================
 /// accessor destruction
 //==============================================================================
@@ -583,9 +726,22 @@ void contra_legion_partition_destroy(
     legion_context_t * ctx,
     legion_index_partition_t * part)
 {
+  releaseIndexedPartition(part);
   legion_index_partition_destroy(*runtime, *ctx, *part);
 }
 
+//==============================================================================
+/// Wait for all issued work
+//==============================================================================
+void contra_legion_fence(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx)
+{
+  auto fut = legion_runtime_issue_execution_fence(*runtime, *ctx);
+  legion_future_get_void_result(fut);
+  legion_future_destroy(fut);
+}
+
 //==============================================================================
 /// get the timer
 //==============================================================================
@@ -604,6 +760,44 @@ void contra_legion_timer_stop(real_t *)
   //std::cout << get_wall_time()*1e3 - *time << std::endl;
 }
 
+//==============================================================================
+/// Is this the first shard of a replicated task
+//==============================================================================
+bool contra_legion_test_root(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx)
+{
+  return legion_runtime_local_shard(*runtime, *ctx) == 0;
+}
+
+//==============================================================================
+/// Begin a trace
+//==============================================================================
+void contra_legion_trace_begin(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx,
+    legion_trace_id_t tid,
+    int_t * iteration)
+{
+  // the first iteration creates the cached partitions, so it is not traced
+  if (*iteration > 0)
+    legion_runtime_begin_trace(*runtime, *ctx, tid, false);
+}
+
+//==============================================================================
+/// End a trace
+//==============================================================================
+void contra_legion_trace_end(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx,
+    legion_trace_id_t tid,
+    int_t * iteration)
+{
+  if (*iteration > 0)
+    legion_runtime_end_trace(*runtime, *ctx, tid);
+  (*iteration)++;
+}
+
 //==============================================================================
 /// Create a reduction
 //==============================================================================
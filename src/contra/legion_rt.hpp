@@ -262,6 +262,14 @@ void contra_legion_index_space_partition_from_field(
     contra_legion_partitions_t ** parts,
     legion_index_partition_t * part);
 
+/// block partition of a row-major index space
+void contra_legion_index_space_partition_from_blocks(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx,
+    dopevector_t * dims,
+    dopevector_t * blocks,
+    contra_legion_index_space_t * is,
+    legion_index_partition_t * part);
 
 /// index space partitioning
 void contra_legion_index_space_create(
@@ -336,12 +344,15 @@ void contra_legion_index_add_region_requirement(
     contra_legion_index_space_t * cs,
     contra_legion_partitions_t ** parts,
     legion_index_partition_t * specified_part,
-    contra_legion_field_t * field);
+    contra_legion_field_t * field,
+    legion_privilege_mode_t privilege,
+    legion_reduction_op_id_t redop);
 
 /// field addition
 void contra_legion_task_add_region_requirement(
     legion_task_launcher_t * launcher,
-    contra_legion_field_t * field );
+    contra_legion_field_t * field,
+    legion_privilege_mode_t privilege);
 
 /// partition create
 void contra_legion_partitions_create(
@@ -371,18 +382,6 @@ void contra_legion_get_accessor(
     uint32_t* field_id,
     contra_legion_accessor_t* acc);
 
-/// Accessor write
-void contra_legion_accessor_write(
-    contra_legion_accessor_t * acc,
-    const void * data,
-    int_t index = 0);
-
-/// Accessor read
-void contra_legion_accessor_read(
-    contra_legion_accessor_t * acc,
-    void * data,
-    int_t index = 0);
-
 /// accessor destruction
 void contra_legion_accessor_destroy(
     legion_runtime_t *,
@@ -395,6 +394,28 @@ void contra_legion_partition_destroy(
     legion_context_t * ctx,
     legion_index_partition_t * part);
 
+/// is this the first shard
+bool contra_legion_test_root(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx);
+
+/// loop tracing
+void contra_legion_trace_begin(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx,
+    legion_trace_id_t tid,
+    int_t * iteration);
+void contra_legion_trace_end(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx,
+    legion_trace_id_t tid,
+    int_t * iteration);
+
+/// wait for all issued work
+void contra_legion_fence(
+    legion_runtime_t * runtime,
+    legion_context_t * ctx);
+
 /// get the timer
 real_t get_wall_time(void);
 void contra_legion_timer_start(real_t *);
@@ -0,0 +1,180 @@
+#include "lifetimes.hpp"
+
+namespace contra {
+
+namespace {
+
+//==============================================================================
+// Collects every variable an expression touches
+//==============================================================================
+struct VariableCollector : public RecursiveAstVisiter {
+  std::set<VariableDef*> VarDefs;
+  void postVisit(VarAccessExprAST& e) override
+  { VarDefs.emplace(e.getVariableDef()); }
+  void postVisit(ArrayAccessExprAST& e) override
+  { VarDefs.emplace(e.getVariableDef()); }
+};
+
+} // namespace
+
+//==============================================================================
+void LifetimeIdentifier::runVisitor(FunctionAST&e)
+{
+  // top level variables outlive the expression
+  if (e.isTopLevelExpression()) return;
+  // index task fields are accessors that write back when destroyed
+  if (dynamic_cast<IndexTaskAST*>(&e)) return;
+
+  Fields_.clear();
+  Escaped_.clear();
+  Dependencies_.clear();
+  LastUses_.clear();
+
+  for (const auto & Stmt : e.getBodyExprs()) {
+    CurrentStmt_ = Stmt.get();
+    Depth_ = 0;
+    Stmt->accept(*this);
+  }
+  CurrentStmt_ = nullptr;
+
+  if (e.hasReturn()) escape(e.getReturnExpr());
+
+  for (auto VarDef : Fields_) {
+    if (Escaped_.count(VarDef)) continue;
+    auto it = LastUses_.find(VarDef);
+    if (it != LastUses_.end()) e.addRelease(it->second, VarDef->getName());
+  }
+}
+
+//==============================================================================
+// Partitions built from a field keep it alive
+//==============================================================================
+void LifetimeIdentifier::addUse(VariableDef* VarDef)
+{
+  if (!VarDef || !CurrentStmt_) return;
+  LastUses_[VarDef] = CurrentStmt_;
+  auto it = Dependencies_.find(VarDef);
+  if (it != Dependencies_.end())
+    for (auto FieldDef : it->second) LastUses_[FieldDef] = CurrentStmt_;
+}
+
+//==============================================================================
+void LifetimeIdentifier::addDependencies(VariableDef* PartDef, NodeAST* Expr)
+{
+  VariableCollector Collector;
+  Expr->accept(Collector);
+  auto & Deps = Dependencies_[PartDef];
+  for (auto VarDef : Collector.VarDefs) {
+    if (!VarDef) continue;
+    if (VarDef->getType().isField()) Deps.emplace(VarDef);
+    auto it = Dependencies_.find(VarDef);
+    if (it != Dependencies_.end() && VarDef != PartDef)
+      Deps.insert(it->second.begin(), it->second.end());
+  }
+}
+
+//==============================================================================
+void LifetimeIdentifier::escape(NodeAST* Expr)
+{
+  VariableCollector Collector;
+  Expr->accept(Collector);
+  Escaped_.insert(Collector.VarDefs.begin(), Collector.VarDefs.end());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Vizitors
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+bool LifetimeIdentifier::preVisit(ForStmtAST&)
+{
+  Depth_++;
+  return false;
+}
+
+//==============================================================================
+void LifetimeIdentifier::postVisit(ForStmtAST&)
+{ Depth_--; }
+
+//==============================================================================
+bool LifetimeIdentifier::preVisit(ForeachStmtAST& e)
+{
+  // the body of a lifted loop has moved to its task
+  for (auto VarDef : e.getAccessedVariables()) addUse(VarDef);
+  Depth_++;
+  return false;
+}
+
+//==============================================================================
+void LifetimeIdentifier::postVisit(ForeachStmtAST&)
+{ Depth_--; }
+
+//==============================================================================
+bool LifetimeIdentifier::preVisit(IfStmtAST&)
+{
+  Depth_++;
+  return false;
+}
+
+//==============================================================================
+void LifetimeIdentifier::postVisit(IfStmtAST&)
+{ Depth_--; }
+
+//==============================================================================
+bool LifetimeIdentifier::preVisit(AssignStmtAST& e)
+{
+  auto NumLeft = e.getNumLeftExprs();
+  auto NumRight = e.getNumRightExprs();
+
+  for (unsigned il=0, ir=0; il<NumLeft; il++) {
+    auto LeftExpr = dynamic_cast<VarAccessExprAST*>(e.getLeftExpr(il));
+    auto RightExpr = e.getRightExpr(ir);
+    if (NumRight>1) ir++;
+    if (!LeftExpr) continue;
+
+    auto VarDef = LeftExpr->getVariableDef();
+    const auto & VarType = VarDef->getType();
+
+    // only fields created in the outermost scope can be freed early
+    if (!Depth_ && VarType.isField()) Fields_.emplace(VarDef);
+
+    if (VarType.isPartition()) addDependencies(VarDef, RightExpr);
+
+    // copies might share storage
+    auto IsWhole = [](NodeAST* Expr) {
+      return dynamic_cast<VarAccessExprAST*>(Expr) &&
+        !dynamic_cast<ArrayAccessExprAST*>(Expr);
+    };
+    if (VarType.isField() && IsWhole(LeftExpr) && IsWhole(RightExpr)) {
+      Escaped_.emplace(VarDef);
+      escape(RightExpr);
+    }
+  }
+
+  return false;
+}
+
+//==============================================================================
+void LifetimeIdentifier::postVisit(CallExprAST& e)
+{
+  // tasks may still be running after the launch returns
+  if (e.getFunctionDef()->isTask())
+    for (const auto & Arg : e.getArgExprs()) escape(Arg.get());
+}
+
+//==============================================================================
+void LifetimeIdentifier::postVisit(PartitionStmtAST& e)
+{
+  auto NumVars = e.getNumVars();
+  for (unsigned i=0; i<NumVars; ++i) addUse(e.getVarDef(i));
+}
+
+//==============================================================================
+void LifetimeIdentifier::postVisit(VarAccessExprAST& e)
+{ addUse(e.getVariableDef()); }
+
+//==============================================================================
+void LifetimeIdentifier::postVisit(ArrayAccessExprAST& e)
+{ addUse(e.getVariableDef()); }
+
+} // namespace
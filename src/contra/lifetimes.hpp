@@ -0,0 +1,52 @@
+#ifndef CONTRA_LIFETIMES_HPP
+#define CONTRA_LIFETIMES_HPP
+
+#include "config.hpp"
+#include "recursive.hpp"
+
+#include <map>
+#include <set>
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Identifies the last statement that needs each field
+////////////////////////////////////////////////////////////////////////////////
+class LifetimeIdentifier : public RecursiveAstVisiter {
+
+  unsigned Depth_ = 0;
+  const NodeAST* CurrentStmt_ = nullptr;
+
+  std::set<VariableDef*> Fields_;
+  std::set<VariableDef*> Escaped_;
+  std::map<VariableDef*, std::set<VariableDef*>> Dependencies_;
+  std::map<VariableDef*, const NodeAST*> LastUses_;
+
+  void addUse(VariableDef* VarDef);
+  void addDependencies(VariableDef* PartDef, NodeAST* Expr);
+  void escape(NodeAST* Expr);
+
+public:
+
+  void runVisitor(FunctionAST&e);
+
+  bool preVisit(ForStmtAST& e) override;
+  void postVisit(ForStmtAST& e) override;
+
+  bool preVisit(ForeachStmtAST& e) override;
+  void postVisit(ForeachStmtAST& e) override;
+
+  bool preVisit(IfStmtAST& e) override;
+  void postVisit(IfStmtAST& e) override;
+
+  bool preVisit(AssignStmtAST& e) override;
+  void postVisit(CallExprAST& e) override;
+  void postVisit(PartitionStmtAST& e) override;
+  void postVisit(VarAccessExprAST& e) override;
+  void postVisit(ArrayAccessExprAST& e) override;
+
+};
+
+} // namespace
+
+#endif // CONTRA_LIFETIMES_HPP
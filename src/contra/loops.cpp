@@ -1,9 +1,34 @@
+#include "args.hpp"
 #include "context.hpp"
 #include "loops.hpp"
 #include "reductions.hpp"
+#include "token.hpp"
+
+#include <algorithm>
+#include <thread>
 
 namespace contra {
 
+using namespace llvm;
+
+////////////////////////////////////////////////////////////////////////////////
+// Loop args
+////////////////////////////////////////////////////////////////////////////////
+
+cl::opt<bool> OptionLiftLoops(
+    "lift-loops",
+    cl::desc("Run sequential loops without loop-carried dependencies in "
+      "parallel"),
+    cl::init(false),
+    cl::cat(OptionCategory));
+
+cl::opt<unsigned> OptionLiftLoopsChunks(
+    "lift-loops-chunks",
+    cl::desc("Number of chunks lifted loops are split into "
+      "(0 uses the number of cores)"),
+    cl::init(0),
+    cl::cat(OptionCategory));
+
 ////////////////////////////////////////////////////////////////////////////////
 // Vizitors
 ////////////////////////////////////////////////////////////////////////////////
@@ -13,6 +38,7 @@ void LoopLifter::postVisit(ForeachStmtAST&e)
   const auto & LoopVarName = e.getVarName();
 
   std::vector<ReductionDef> ReduceVars;
+  std::vector<ReductionDef> ArgReduceVars;
 
   // determine the reductions
   if (e.hasReduction()) {
@@ -23,8 +49,16 @@ void LoopLifter::postVisit(ForeachStmtAST&e)
         auto NumReduceVars = ReduceExpr->getNumVars();
         const auto & OpName = ReduceExpr->getOperatorName();
         auto ReduceOp = SupportedReductions::getType( OpName );
-        for (unsigned j=0; j<NumReduceVars; ++j)
-          ReduceVars.emplace_back( ReduceExpr->getVarDef(j), ReduceOp );
+        for (unsigned j=0; j<NumReduceVars; ++j) {
+          auto VarDef = ReduceExpr->getVarDef(j);
+          // fields and arrays are combined by the runtime, not returned by
+          // the task
+          const auto & VarType = VarDef->getType();
+          if (VarType.isField() || VarType.isArray())
+            ArgReduceVars.emplace_back( VarDef, ReduceOp );
+          else
+            ReduceVars.emplace_back( VarDef, ReduceOp );
+        }
       }
     }
     e.setReductionVars( ReduceVars );
@@ -41,10 +75,461 @@ void LoopLifter::postVisit(ForeachStmtAST&e)
       e.moveBodyExprs(),
       LoopVarName,
       e.getAccessedVariables(),
-      ReduceVars);
+      ReduceVars,
+      ArgReduceVars);
 
   addFunctionAST(std::move(IndexTask));
 
 }
 
+
+////////////////////////////////////////////////////////////////////////////////
+// Dependence checks
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+//==============================================================================
+// variables the analysis knows how to pass to an index task
+//==============================================================================
+bool isPlainVariable(const VariableType & Type)
+{
+  return !Type.isFuture() && !Type.isField() && !Type.isRange() &&
+    !Type.isPartition() && !Type.isStruct();
+}
+
+//==============================================================================
+// only +/* reductions recognized
+//==============================================================================
+bool isReductionOp(char Op)
+{ return Op == tok_add || Op == tok_mul; }
+
+//==============================================================================
+// Walks a loop body and proves each iteration independent of the others.
+// Outer variables may be read, but only written through a recognized
+// reduction like 's = s + x'.
+//==============================================================================
+struct DependenceChecker : public RecursiveAstVisiter {
+
+  const std::set<VariableDef*> & OuterVars;
+  const std::set<VariableDef*> & MaybeFutures;
+  const std::string & LoopVarName;
+
+  bool IsIndependent = true;
+  std::map<VariableDef*, unsigned> NumUses;
+  std::map<VariableDef*, char> Reductions;
+  
+  DependenceChecker(
+      const std::set<VariableDef*> & Outer,
+      const std::set<VariableDef*> & Futures,
+      const std::string & VarName) :
+    OuterVars(Outer), MaybeFutures(Futures), LoopVarName(VarName)
+  {}
+
+  bool isOuter(VariableDef* VarDef) const
+  { return OuterVars.count(VarDef); }
+
+  void addUse(VarAccessExprAST& e) {
+    auto VarDef = e.getVariableDef();
+    if (!isOuter(VarDef)) return;
+    if (!isPlainVariable(VarDef->getType())) IsIndependent = false;
+    NumUses[VarDef]++;
+  }
+
+  void addReduction(AssignStmtAST& e, VariableDef* VarDef) {
+    if (e.getNumLeftExprs() != 1 || e.getNumRightExprs() != 1 || e.getCast(0))
+    {
+      IsIndependent = false;
+      return;
+    }
+    if (VarDef->getType().isArray() || MaybeFutures.count(VarDef)) {
+      IsIndependent = false;
+      return;
+    }
+    auto BinaryExpr = dynamic_cast<BinaryExprAST*>(e.getRightExpr(0));
+    if (!BinaryExpr || !isReductionOp(BinaryExpr->getOperand())) {
+      IsIndependent = false;
+      return;
+    }
+    // the variable itself must be one of the operands
+    auto IsSelf = [=](NodeAST* Expr) {
+      if (dynamic_cast<ArrayAccessExprAST*>(Expr)) return false;
+      auto VarExpr = dynamic_cast<VarAccessExprAST*>(Expr);
+      return VarExpr && VarExpr->getVariableDef() == VarDef;
+    };
+    if (!IsSelf(BinaryExpr->getLeftExpr()) && !IsSelf(BinaryExpr->getRightExpr()))
+    {
+      IsIndependent = false;
+      return;
+    }
+    if (!Reductions.emplace(VarDef, BinaryExpr->getOperand()).second)
+      IsIndependent = false;
+  }
+
+  bool preVisit(AssignStmtAST& e) override {
+    auto NumLeft = e.getNumLeftExprs();
+    for (unsigned i=0; i<NumLeft; ++i) {
+      auto VarExpr = dynamic_cast<VarAccessExprAST*>(e.getLeftExpr(i));
+      if (!VarExpr) continue;
+      if (VarExpr->getName() == LoopVarName) IsIndependent = false;
+      auto VarDef = VarExpr->getVariableDef();
+      if (!isOuter(VarDef)) continue;
+      // tasks get their own copy of an array
+      if (dynamic_cast<ArrayAccessExprAST*>(VarExpr)) IsIndependent = false;
+      else addReduction(e, VarDef);
+    }
+    return false;
+  }
+
+  bool preVisit(CallExprAST& e) override {
+    const auto & Name = e.getName();
+    auto FunDef = e.getFunctionDef();
+    if (!dynamic_cast<BuiltInFunction*>(FunDef) || Name == "print" ||
+        Name == "timer" || Name == "part" || Name == "blocks")
+      IsIndependent = false;
+    return false;
+  }
+
+  bool preVisit(BreakStmtAST&) override
+  { IsIndependent = false; return true; }
+  
+  bool preVisit(ForeachStmtAST&) override
+  { IsIndependent = false; return true; }
+  
+  bool preVisit(PartitionStmtAST&) override
+  { IsIndependent = false; return true; }
+  
+  bool preVisit(ReductionStmtAST&) override
+  { IsIndependent = false; return true; }
+
+  void postVisit(VarAccessExprAST& e) override { addUse(e); }
+  void postVisit(ArrayAccessExprAST& e) override { addUse(e); }
+
+  bool check() const {
+    if (!IsIndependent) return false;
+    // the reduction must be the only place its variable appears
+    for (const auto & Reduce : Reductions)
+      if (NumUses.at(Reduce.first) != 2) return false;
+    return true;
+  }
+};
+
+//==============================================================================
+unsigned getNumChunks()
+{
+  unsigned NumChunks = OptionLiftLoopsChunks;
+  if (!NumChunks) NumChunks = std::thread::hardware_concurrency();
+  return std::max(NumChunks, 1u);
+}
+
+//==============================================================================
+// Finds variables that might hold a future once futures are identified
+//==============================================================================
+struct FutureSourceFinder : public RecursiveAstVisiter {
+  
+  std::set<VariableDef*> & Sources;
+
+  FutureSourceFinder(std::set<VariableDef*> & S) : Sources(S) {}
+
+  static bool hasTaskCall(NodeAST* Expr) {
+    struct CallFinder : public RecursiveAstVisiter {
+      bool HasCall = false;
+      void postVisit(CallExprAST& e) override
+      { if (e.getFunctionDef()->isTask()) HasCall = true; }
+    };
+    CallFinder Finder;
+    Expr->accept(Finder);
+    return Finder.HasCall;
+  }
+
+  void postVisit(AssignStmtAST& e) override {
+    auto NumLeft = e.getNumLeftExprs();
+    auto NumRight = e.getNumRightExprs();
+    for (unsigned il=0, ir=0; il<NumLeft; il++) {
+      auto LeftExpr = dynamic_cast<VarAccessExprAST*>(e.getLeftExpr(il));
+      auto RightExpr = e.getRightExpr(ir);
+      if (LeftExpr && (hasTaskCall(RightExpr) || 
+            dynamic_cast<VarAccessExprAST*>(RightExpr)))
+        Sources.emplace(LeftExpr->getVariableDef());
+      if (NumRight>1) ir++;
+    }
+  }
+};
+
+} // namespace
+
+//==============================================================================
+void LoopParallelizer::runVisitor(FunctionAST&e)
+{
+  if (!OptionLiftLoops) return;
+  // index launches are only made from tasks
+  if (e.isTopLevelExpression() || !e.isTask()) return;
+
+  CurrentName_ = e.getName();
+  MaybeFutures_.clear();
+
+  FutureSourceFinder Finder(MaybeFutures_);
+  e.accept(Finder);
+
+  auto NumBody = e.getNumBodyExprs();
+  for (unsigned i=0; i<NumBody; ++i)
+    if (isLiftable(e.getBodyExprs()[i].get()))
+      e.setBodyExpr(i, liftLoop(e.moveBodyExpr(i)));
+  
+  e.accept(*this);
+}
+
+//==============================================================================
+std::unique_ptr<NodeAST> LoopParallelizer::cloneBound(NodeAST* Expr)
+{
+  const auto & Loc = Expr->getLoc();
+  auto I64Type = VariableType(Context::instance().getInt64Type());
+
+  if (auto ValueExpr = dynamic_cast<ValueExprAST*>(Expr)) {
+    if (ValueExpr->getValueType() != ValueExprAST::ValueType::Int)
+      return nullptr;
+    auto NewExpr = std::make_unique<ValueExprAST>(
+        Loc,
+        std::to_string(ValueExpr->getVal<int_t>()),
+        ValueExprAST::ValueType::Int);
+    NewExpr->setType(I64Type);
+    return NewExpr;
+  }
+  else if (dynamic_cast<ArrayAccessExprAST*>(Expr)) {
+    return nullptr;
+  }
+  else if (auto VarExpr = dynamic_cast<VarAccessExprAST*>(Expr)) {
+    auto VarDef = VarExpr->getVariableDef();
+    if (!VarDef || MaybeFutures_.count(VarDef)) return nullptr;
+    const auto & VarType = VarDef->getType();
+    if (VarType.getBaseType() != I64Type.getBaseType() || VarType.isArray() ||
+        !isPlainVariable(VarType))
+      return nullptr;
+    auto NewExpr = std::make_unique<VarAccessExprAST>(Loc, VarExpr->getVarId());
+    NewExpr->setVariableDef(VarDef);
+    NewExpr->setType(I64Type);
+    BoundVars_.emplace(VarDef);
+    return NewExpr;
+  }
+  else if (auto BinaryExpr = dynamic_cast<BinaryExprAST*>(Expr)) {
+    auto Op = BinaryExpr->getOperand();
+    if (Op != tok_add && Op != tok_sub && Op != tok_mul && Op != tok_div)
+      return nullptr;
+    auto LeftExpr = cloneBound(BinaryExpr->getLeftExpr());
+    auto RightExpr = cloneBound(BinaryExpr->getRightExpr());
+    if (!LeftExpr || !RightExpr) return nullptr;
+    auto NewExpr = std::make_unique<BinaryExprAST>(
+        Loc,
+        Op,
+        std::move(LeftExpr),
+        std::move(RightExpr));
+    NewExpr->setType(I64Type);
+    return NewExpr;
+  }
+
+  return nullptr;
+}
+
+//==============================================================================
+bool LoopParallelizer::isLiftable(NodeAST* Stmt)
+{
+  auto ForExpr = dynamic_cast<ForStmtAST*>(Stmt);
+  if (!ForExpr || dynamic_cast<ForeachStmtAST*>(Stmt)) return false;
+
+  auto RangeExpr = dynamic_cast<RangeExprAST*>(ForExpr->getStartExpr());
+  if (!RangeExpr || RangeExpr->hasStepExpr()) return false;
+
+  // the bounds are re-evaluated inside the index task
+  BoundVars_.clear();
+  auto StartExpr = cloneBound(RangeExpr->getStartExpr());
+  auto EndExpr = cloneBound(RangeExpr->getEndExpr());
+  if (!StartExpr || !EndExpr) return false;
+  
+  // not worth launching for fewer iterations than chunks
+  auto StartVal = dynamic_cast<ValueExprAST*>(StartExpr.get());
+  auto EndVal = dynamic_cast<ValueExprAST*>(EndExpr.get());
+  if (StartVal && EndVal) {
+    auto Size = EndVal->getVal<int_t>() - StartVal->getVal<int_t>() + 1;
+    if (Size < static_cast<int_t>(getNumChunks())) return false;
+  }
+
+  const auto & AccessedVars = ForExpr->getAccessedVariables();
+  std::set<VariableDef*> OuterVars(AccessedVars.begin(), AccessedVars.end());
+
+  DependenceChecker Checker(OuterVars, MaybeFutures_, ForExpr->getVarName());
+  for (const auto & BodyStmt : ForExpr->getBodyExprs())
+    BodyStmt->accept(Checker);
+  if (!Checker.check()) return false;
+
+  // chunks start their reductions from the identity, which would change
+  // the bounds they evaluate
+  for (const auto & Reduce : Checker.Reductions)
+    if (BoundVars_.count(Reduce.first)) return false;
+
+  Reductions_ = Checker.Reductions;
+  return true;
+}
+
+//==============================================================================
+// Rewrites
+//
+//   for i = S:E { body }
+//
+// as
+//
+//   foreach p = 0:P-1 {
+//     reduce(vars : op)
+//     for i = S+(p*N)/P : S+((p+1)*N)/P-1 { body }
+//   }
+//
+// where N = E-S+1.  Each chunk starts its reductions from the identity and
+// the results are combined with the values from before the loop.
+//==============================================================================
+std::unique_ptr<NodeAST> LoopParallelizer::liftLoop(std::unique_ptr<NodeAST> Stmt)
+{
+  auto ForExpr = static_cast<ForStmtAST*>(Stmt.get());
+  const auto & Loc = ForExpr->getLoc();
+
+  auto I64Type = VariableType(Context::instance().getInt64Type());
+  auto RangeType = VariableType(I64Type, VariableType::Attr::Range);
+
+  auto NumChunks = getNumChunks();
+
+  // the chunk index
+  auto PartN = makeName("chunk");
+  auto PartId = Identifier(PartN, Loc);
+  auto PartDef = Context::instance().insertVariable(
+      std::make_unique<VariableDef>(PartN, Loc, I64Type) ).get();
+
+  auto MakeInt = [&](int_t Val) -> std::unique_ptr<NodeAST> {
+    auto Expr = std::make_unique<ValueExprAST>(
+        Loc, std::to_string(Val), ValueExprAST::ValueType::Int);
+    Expr->setType(I64Type);
+    return Expr;
+  };
+  auto MakePart = [&]() -> std::unique_ptr<NodeAST> {
+    auto Expr = std::make_unique<VarAccessExprAST>(Loc, PartId);
+    Expr->setVariableDef(PartDef);
+    Expr->setType(I64Type);
+    return Expr;
+  };
+  auto MakeOp = [&](
+      char Op,
+      std::unique_ptr<NodeAST> Lhs,
+      std::unique_ptr<NodeAST> Rhs) -> std::unique_ptr<NodeAST>
+  {
+    auto Expr = std::make_unique<BinaryExprAST>(
+        Loc, Op, std::move(Lhs), std::move(Rhs));
+    Expr->setType(I64Type);
+    return Expr;
+  };
+  
+  // chunk bounds
+  auto RangeExpr = static_cast<RangeExprAST*>(ForExpr->getStartExpr());
+  BoundVars_.clear();
+  auto MakeStart = [&]() { return cloneBound(RangeExpr->getStartExpr()); };
+  auto MakeSize = [&]() {
+    return MakeOp(tok_add,
+        MakeOp(tok_sub, cloneBound(RangeExpr->getEndExpr()), MakeStart()),
+        MakeInt(1));
+  };
+  
+  auto LowerExpr = MakeOp(tok_add,
+      MakeStart(),
+      MakeOp(tok_div, MakeOp(tok_mul, MakePart(), MakeSize()), MakeInt(NumChunks)));
+  
+  auto UpperExpr = MakeOp(tok_sub,
+      MakeOp(tok_add,
+        MakeStart(),
+        MakeOp(tok_div,
+          MakeOp(tok_mul, MakeOp(tok_add, MakePart(), MakeInt(1)), MakeSize()),
+          MakeInt(NumChunks))),
+      MakeInt(1));
+
+  auto ChunkRange = std::make_unique<RangeExprAST>(
+      Loc, std::move(LowerExpr), std::move(UpperExpr));
+  ChunkRange->setType(RangeType);
+  ForExpr->setStartExpr( std::move(ChunkRange) );
+  
+  // group the reductions by operator
+  std::map<char, std::vector<VariableDef*>> ReduceVars;
+  for (const auto & Reduce : Reductions_)
+    ReduceVars[Reduce.second].emplace_back(Reduce.first);
+
+  ASTBlock Body;
+  for (const auto & Reduce : ReduceVars) {
+    std::vector<Identifier> VarIds;
+    for (auto VarDef : Reduce.second) VarIds.emplace_back(VarDef->getName(), Loc);
+    auto ReduceExpr = std::make_unique<ReductionStmtAST>(
+        Loc,
+        VarIds,
+        Reduce.first,
+        std::string(1, Reduce.first),
+        Loc);
+    for (unsigned i=0; i<Reduce.second.size(); ++i)
+      ReduceExpr->setVarDef(i, Reduce.second[i]);
+    Body.emplace_back( std::move(ReduceExpr) );
+  }
+  auto NumQual = Body.size();
+  
+  // the task needs everything the loop and its bounds read
+  std::set<VariableDef*> AccessedVars(BoundVars_);
+  for (auto VarDef : ForExpr->getAccessedVariables()) AccessedVars.emplace(VarDef);
+  std::vector<VariableDef*> SortedVars(AccessedVars.begin(), AccessedVars.end());
+  std::sort(
+      SortedVars.begin(),
+      SortedVars.end(),
+      [](const auto a, const auto b)
+      { return a->getName() < b->getName(); });
+  
+  Body.emplace_back( std::move(Stmt) );
+  
+  auto PartRange = std::make_unique<RangeExprAST>(
+      Loc, MakeInt(0), MakeInt(NumChunks-1));
+  PartRange->setName(makeName("chunks"));
+  PartRange->setType(RangeType);
+
+  auto Foreach = std::make_unique<ForeachStmtAST>(
+      Loc,
+      PartId,
+      std::move(PartRange),
+      std::move(Body));
+  Foreach->setNumQualifiers(NumQual);
+  if (NumQual) Foreach->setHasReduction();
+  Foreach->setAccumulate();
+  Foreach->setAccessedVariables(SortedVars);
+
+  return Foreach;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Vizitors
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+bool LoopParallelizer::preVisit(ForStmtAST& e)
+{
+  auto NumBody = e.getBodyExprs().size();
+  for (unsigned i=0; i<NumBody; ++i)
+    if (isLiftable(e.getBodyExprs()[i].get()))
+      e.setBodyExpr(i, liftLoop(e.moveBodyExpr(i)));
+  return false;
+}
+
+//==============================================================================
+bool LoopParallelizer::preVisit(IfStmtAST& e)
+{
+  auto NumThen = e.getThenExprs().size();
+  for (unsigned i=0; i<NumThen; ++i)
+    if (isLiftable(e.getThenExprs()[i].get()))
+      e.setThenExpr(i, liftLoop(e.moveThenExpr(i)));
+  
+  auto NumElse = e.getElseExprs().size();
+  for (unsigned i=0; i<NumElse; ++i)
+    if (isLiftable(e.getElseExprs()[i].get()))
+      e.setElseExpr(i, liftLoop(e.moveElseExpr(i)));
+  
+  return false;
+}
+
 }
@@ -5,6 +5,8 @@
 #include "recursive.hpp"
 
 #include <deque>
+#include <map>
+#include <set>
 
 namespace contra {
 
@@ -55,6 +57,41 @@ public:
 
 };
 
+////////////////////////////////////////////////////////////////////////////////
+/// Turns sequential loops without loop-carried dependencies into foreach
+/// loops over a fixed number of chunks.
+////////////////////////////////////////////////////////////////////////////////
+class LoopParallelizer : public RecursiveAstVisiter {
+
+  std::map<std::string, unsigned> LoopCounters_;
+  std::set<VariableDef*> MaybeFutures_;
+  std::set<VariableDef*> BoundVars_;
+  std::map<VariableDef*, char> Reductions_;
+
+  std::string CurrentName_;
+
+  auto makeName(const std::string & BaseName) { 
+    auto & Id = LoopCounters_[BaseName];
+    std::stringstream Name;
+    Name << "__" << CurrentName_ << "_" << BaseName << Id << "__";
+    Id++;
+    return Name.str();
+  }
+
+  std::unique_ptr<NodeAST> cloneBound(NodeAST* Expr);
+  bool isLiftable(NodeAST* Stmt);
+  std::unique_ptr<NodeAST> liftLoop(std::unique_ptr<NodeAST> Stmt);
+
+public:
+
+  void runVisitor(FunctionAST&e);
+  
+  bool preVisit(ForStmtAST& e) override;
+  bool preVisit(ForeachStmtAST&) override { return true; }
+  bool preVisit(IfStmtAST& e) override;
+
+};
+
 
 
 }
@@ -0,0 +1,98 @@
+#include "moves.hpp"
+
+namespace contra {
+
+//==============================================================================
+void MoveIdentifier::runVisitor(FunctionAST&e)
+{
+  // top level variables outlive the expression
+  if (e.isTopLevelExpression()) return;
+
+  LoopDepth_ = 0;
+  NumUses_ = 0;
+  LastUses_.clear();
+  Candidates_.clear();
+
+  e.accept(*this);
+
+  // only uses that nothing follows in program order can be moved
+  for (const auto & Candidate : Candidates_) {
+    auto VarExpr = Candidate.first;
+    if (LastUses_.at(VarExpr->getName()) == Candidate.second)
+      VarExpr->setLastUse();
+  }
+}
+
+//==============================================================================
+unsigned MoveIdentifier::addUse(const std::string & Name)
+{
+  auto Use = NumUses_++;
+  LastUses_[Name] = Use;
+  return Use;
+}
+
+//==============================================================================
+void MoveIdentifier::addUse(VarAccessExprAST& e)
+{
+  auto Use = addUse(e.getName());
+  auto it = Candidates_.find(&e);
+  if (it != Candidates_.end()) it->second = Use;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Vizitors
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+bool MoveIdentifier::preVisit(ForStmtAST&)
+{
+  LoopDepth_++;
+  return false;
+}
+
+//==============================================================================
+void MoveIdentifier::postVisit(ForStmtAST&)
+{ LoopDepth_--; }
+
+//==============================================================================
+bool MoveIdentifier::preVisit(ForeachStmtAST& e)
+{
+  // the body of a lifted loop has moved to its task
+  for (auto VarDef : e.getAccessedVariables()) addUse(VarDef->getName());
+  LoopDepth_++;
+  return false;
+}
+
+//==============================================================================
+void MoveIdentifier::postVisit(ForeachStmtAST&)
+{ LoopDepth_--; }
+
+//==============================================================================
+bool MoveIdentifier::preVisit(AssignStmtAST& e)
+{
+  // a loop body runs again after its last use
+  if (LoopDepth_) return false;
+  if (e.getNumLeftExprs() != 1 || e.getNumRightExprs() != 1) return false;
+  if (e.getCast(0)) return false;
+
+  auto RightExpr = e.getRightExpr(0);
+  if (dynamic_cast<ArrayAccessExprAST*>(RightExpr)) return false;
+  auto VarExpr = dynamic_cast<VarAccessExprAST*>(RightExpr);
+  if (!VarExpr) return false;
+
+  auto VarDef = VarExpr->getVariableDef();
+  if (!VarDef || !VarDef->isArray() || VarDef->isField()) return false;
+
+  Candidates_.emplace(VarExpr, 0);
+  return false;
+}
+
+//==============================================================================
+void MoveIdentifier::postVisit(VarAccessExprAST& e)
+{ addUse(e); }
+
+//==============================================================================
+void MoveIdentifier::postVisit(ArrayAccessExprAST& e)
+{ addUse(e); }
+
+} // namespace
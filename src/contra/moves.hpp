@@ -0,0 +1,45 @@
+#ifndef CONTRA_MOVES_HPP
+#define CONTRA_MOVES_HPP
+
+#include "config.hpp"
+#include "recursive.hpp"
+
+#include <map>
+#include <string>
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Identifies array assignments whose source is never used again
+////////////////////////////////////////////////////////////////////////////////
+class MoveIdentifier : public RecursiveAstVisiter {
+
+  unsigned LoopDepth_ = 0;
+  unsigned NumUses_ = 0;
+
+  std::map<std::string, unsigned> LastUses_;
+  std::map<VarAccessExprAST*, unsigned> Candidates_;
+
+  unsigned addUse(const std::string & Name);
+  void addUse(VarAccessExprAST& e);
+
+public:
+
+  void runVisitor(FunctionAST&e);
+
+  bool preVisit(ForStmtAST& e) override;
+  void postVisit(ForStmtAST& e) override;
+
+  bool preVisit(ForeachStmtAST& e) override;
+  void postVisit(ForeachStmtAST& e) override;
+
+  bool preVisit(AssignStmtAST& e) override;
+
+  void postVisit(VarAccessExprAST& e) override;
+  void postVisit(ArrayAccessExprAST& e) override;
+
+};
+
+} // namespace
+
+#endif // CONTRA_MOVES_HPP
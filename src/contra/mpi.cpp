@@ -1,9 +1,11 @@
 #include "mpi.hpp"
 
+#include "args.hpp"
 #include "errors.hpp"
 
 #include "librt/dopevector.hpp"
 #include "utils/llvm_utils.hpp"
+#include "utils/string_utils.hpp"
 
 #include "llvm/Support/raw_ostream.h"
 
@@ -18,6 +20,15 @@ namespace contra {
 using namespace llvm;
 using namespace utils;
 
+////////////////////////////////////////////////////////////////////////////////
+// Mpi tasker args
+////////////////////////////////////////////////////////////////////////////////
+
+cl::opt<std::string> OptionMpi(
+    "mpi-opts",
+    cl::desc("MPI runtime options"),
+    cl::cat(OptionCategory));
+
 //==============================================================================
 // Constructor
 //==============================================================================
@@ -29,6 +40,7 @@ MpiTasker::MpiTasker(utils::BuilderHelper & TheHelper)
   TaskInfoType_ = VoidPtrType_->getPointerTo();
   FieldType_ = createFieldType();
   AccessorType_ = createAccessorType();
+  FutureType_ = createFutureType();
 }
 
 //==============================================================================
@@ -140,6 +152,16 @@ StructType * MpiTasker::createIndexPartitionType()
   return NewType;
 }
 
+//==============================================================================
+// Create the future data type
+//==============================================================================
+StructType * MpiTasker::createFutureType()
+{
+  std::vector<Type*> members = { VoidPtrType_ };
+  auto NewType = StructType::create( TheContext_, members, "contra_mpi_future_t" );
+  return NewType;
+}
+
 //==============================================================================
 // Create partitioninfo
 //==============================================================================
@@ -171,12 +193,35 @@ void MpiTasker::destroyTaskInfo(Module & TheModule, AllocaInst* PartA)
 //==============================================================================
 void MpiTasker::startRuntime(Module &TheModule)
 {
+  // setup backend args
+  std::vector<std::string> Argv  = {"./contra"};
+
+  auto SplitArgs = utils::split(OptionMpi, ' ');
+  for (const auto & A : SplitArgs) 
+    Argv.emplace_back(A);
+
+  auto ArgcV = llvmValue(TheContext_, Int32Type_, Argv.size());
+
+  std::vector<Constant*> ArgVs;
+  for (const auto & A : Argv)
+    ArgVs.emplace_back( llvmString(TheContext_, TheModule, A) );
+
+  auto ZeroC = Constant::getNullValue(IntegerType::getInt32Ty(TheContext_));
+  auto ArgvV = llvmArray(TheContext_, TheModule, ArgVs, {ZeroC, ZeroC});
+
   TheHelper_.callFunction(
       TheModule,
       "contra_mpi_init",
-      VoidType_);
+      VoidType_,
+      {ArgcV, ArgvV});
 
   launch(TheModule, *TopLevelTask_);
+  
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_mpi_finalize",
+      VoidType_,
+      {});
 }
 
 //==============================================================================
@@ -398,11 +443,12 @@ Value* MpiTasker::launch(
   Builder_.CreateStore(DistV, DistA);
 
   DistV = TheHelper_.load(DistA);
+  auto TaskNameV = llvmString(TheContext_, TheModule, TaskI.getName());
   TheHelper_.callFunction(
       TheModule,
       "contra_mpi_loop_bounds",
       VoidType_,
-      {IndexSpaceA, VarA, EndA, StepA, DistV});
+      {IndexSpaceA, VarA, EndA, StepA, DistV, TaskNameV, TaskInfoA});
   
   //----------------------------------------------------------------------------
   // Fetch fields
@@ -427,6 +473,13 @@ Value* MpiTasker::launch(
         IndexPartitionA = TheHelper_.getAsAlloca(IndexPartitionV);
       }
 
+      if (!TaskI.getArgReduction(i) && isWrite(TaskI.getArgAccess(i))) {
+        TheHelper_.callFunction(
+            TheModule,
+            "contra_mpi_partition_check_write",
+            VoidType_,
+            {IndexPartitionA});
+      }
 
       FieldToPart[FieldA] = IndexPartitionA;
 
@@ -435,11 +488,38 @@ Value* MpiTasker::launch(
           TheModule,
           "contra_mpi_field_fetch",
           VoidType_,
-          {IndexSpaceA, DistV, IndexPartitionA, ArgAs[i]});
+          {IndexSpaceA, DistV, IndexPartitionA, ArgAs[i], TaskInfoA});
 
     } // field
   }
   
+  //----------------------------------------------------------------------------
+  // Only one rank keeps the old array values to reduce into
+  
+  for (const auto & ReduceI : TaskI.getArgReductions()) {
+    auto ArrayA = ArgAs[ReduceI.first];
+    if (isField(ArrayA)) continue;
+    const auto & Reduction = ReduceI.second;
+    auto OpV = llvmValue<int_t>(TheContext_, static_cast<int_t>(Reduction.Op));
+    auto IsRealV = llvmValue<int_t>(
+        TheContext_,
+        Reduction.DataType->isFloatingPointTy());
+    TheHelper_.callFunction(
+        TheModule,
+        "contra_mpi_array_reduction_setup",
+        VoidType_,
+        {TheHelper_.getAsAlloca(ArrayA), OpV, IsRealV});
+  }
+  
+  //----------------------------------------------------------------------------
+  // Order index points so those with local data run while data is in flight
+  
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_mpi_loop_schedule",
+      VoidType_,
+      {TaskInfoA, TheHelper_.load(VarA), TheHelper_.load(EndA), TheHelper_.load(StepA)});
+  
   //----------------------------------------------------------------------------
   // Reduction
   
@@ -496,17 +576,37 @@ Value* MpiTasker::launch(
   // Call function
   
   CurV = TheHelper_.load(VarA);
+  CurV = TheHelper_.callFunction(
+      TheModule,
+      "contra_mpi_loop_index",
+      IntType_,
+      {TaskInfoA, CurV});
   
   std::vector<Value*> ArgVs;
-  for (auto ArgA : ArgAs) {
+  for (unsigned i=0; i<NumArgs; i++) {
+    auto ArgA = ArgAs[i];
     if (isField(ArgA)) {
       auto AccA = TheHelper_.createEntryBlockAlloca(AccessorType_, "acc");
       auto PartA = FieldToPart.at(ArgA);
-      TheHelper_.callFunction(
-          TheModule,
-          "contra_mpi_accessor_setup",
-          VoidType_,
-          {CurV, PartA, ArgA, AccA}); 
+      // reductions start from a buffer of their own
+      if (auto ReduceI = TaskI.getArgReduction(i)) {
+        auto OpV = llvmValue<int_t>(TheContext_, static_cast<int_t>(ReduceI->Op));
+        auto IsRealV = llvmValue<int_t>(
+            TheContext_,
+            ReduceI->DataType->isFloatingPointTy());
+        TheHelper_.callFunction(
+            TheModule,
+            "contra_mpi_accessor_setup_reduce",
+            VoidType_,
+            {CurV, PartA, ArgA, AccA, OpV, IsRealV, TaskInfoA}); 
+      }
+      else {
+        TheHelper_.callFunction(
+            TheModule,
+            "contra_mpi_accessor_setup",
+            VoidType_,
+            {CurV, PartA, ArgA, AccA}); 
+      }
       ArgA = AccA;
     }
     ArgVs.emplace_back( TheHelper_.getAsValue(ArgA) );
@@ -516,11 +616,24 @@ Value* MpiTasker::launch(
    
   Type* ResultT = ResultA ? TheHelper_.getAllocatedType(ResultA) : VoidType_;
 
+  // index points are timed to rebalance repeated launches
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_mpi_point_start",
+      VoidType_,
+      {TaskInfoA});
+
   auto ResultV = TheHelper_.callFunction(
       TheModule,
       TaskI.getName(),
       ResultT,
       {ArgVs});
+  
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_mpi_point_stop",
+      VoidType_,
+      {TaskInfoA, CurV});
 
   if (ResultA) {
     auto ReduceOp = dynamic_cast<const MpiReduceInfo*>(AbstractReduceOp);
@@ -556,27 +669,51 @@ Value* MpiTasker::launch(
   //TheFunction->getBasicBlockList().push_back(AfterBB);
   Builder_.SetInsertPoint(AfterBB);
   
+  //----------------------------------------------------------------------------
+  // Send reduced field entries to their owners, and combine arrays everywhere
+  
+  for (const auto & ReduceI : TaskI.getArgReductions()) {
+    auto ArgA = TheHelper_.getAsAlloca(ArgAs[ReduceI.first]);
+    const auto & Reduction = ReduceI.second;
+    auto OpV = llvmValue<int_t>(TheContext_, static_cast<int_t>(Reduction.Op));
+    auto IsRealV = llvmValue<int_t>(
+        TheContext_,
+        Reduction.DataType->isFloatingPointTy());
+    if (isField(ArgA))
+      TheHelper_.callFunction(
+          TheModule,
+          "contra_mpi_field_reduce",
+          VoidType_,
+          {ArgA, OpV, IsRealV, TaskInfoA});
+    else
+      TheHelper_.callFunction(
+          TheModule,
+          "contra_mpi_array_reduce",
+          VoidType_,
+          {ArgA, OpV, IsRealV});
+  }
+  
   //----------------------------------------------------------------------------
   // Reduction
   
   if (ResultA) {
     auto ReduceOp = dynamic_cast<const MpiReduceInfo*>(AbstractReduceOp);
     
-    auto ResultT = TheHelper_.getAllocatedType(ResultA);
-    auto TmpResultA = TheHelper_.createEntryBlockAlloca(ResultT);
+    auto FutureA = TheHelper_.createEntryBlockAlloca(FutureType_, "future");
     auto DataSizeV = llvmValue<size_t>(TheContext_, ReduceOp->getDataSize()); 
 
     const auto & FoldN = ReduceOp->getFoldName();
     auto FoldT = ReduceOp->getFoldType();
     auto FoldF = TheModule.getOrInsertFunction(FoldN, FoldT).getCallee();
 
+    // non-blocking, the result is waited on in loadFuture
     TheHelper_.callFunction(
         TheModule,
         "contra_mpi_reduce",
         VoidType_,
-        {FoldF, ResultA, TmpResultA, DataSizeV});
+        {FoldF, ResultA, DataSizeV, FutureA});
 
-    ResultA = TmpResultA;
+    ResultA = FutureA;
   }
 
   
@@ -692,6 +829,72 @@ AllocaInst* MpiTasker::createPartition(
   return IndexPartA;
 }
 
+//==============================================================================
+// create a block partition
+//==============================================================================
+AllocaInst* MpiTasker::createBlockPartition(
+    Module & TheModule,
+    Value* IndexSpaceA,
+    Value* DimsA,
+    Value* BlocksA)
+{
+  auto IndexPartA = TheHelper_.createEntryBlockAlloca(IndexPartitionType_);
+
+  std::vector<Value*> FunArgVs = {
+    TheHelper_.getAsAlloca(DimsA),
+    TheHelper_.getAsAlloca(BlocksA),
+    TheHelper_.getAsAlloca(IndexSpaceA),
+    IndexPartA};
+  
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_mpi_partition_from_blocks",
+      VoidType_,
+      FunArgVs);
+
+  return IndexPartA;
+}
+
+//==============================================================================
+// Is this a future type
+//==============================================================================
+bool MpiTasker::isFuture(Value* FutureA) const
+{
+  auto FutureT = FutureA->getType();
+  if (isa<AllocaInst>(FutureA)) FutureT = FutureT->getPointerElementType();
+  return (FutureT == FutureType_);
+}
+
+//==============================================================================
+// Wait on a future and load its value
+//==============================================================================
+Value* MpiTasker::loadFuture(
+    Module &TheModule,
+    Value* FutureV,
+    Type *DataT)
+{
+  auto FutureA = TheHelper_.getAsAlloca(FutureV);
+  auto DataA = TheHelper_.createEntryBlockAlloca(DataT);
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_mpi_future_wait",
+      VoidType_,
+      {FutureA, DataA});
+  return DataA;
+}
+
+//==============================================================================
+// destroy a future
+//==============================================================================
+void MpiTasker::destroyFuture(Module &TheModule, Value* FutureA)
+{
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_mpi_future_destroy",
+      VoidType_,
+      {FutureA});
+}
+
 //==============================================================================
 // Is this a field type
 //==============================================================================
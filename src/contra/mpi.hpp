@@ -59,6 +59,7 @@ class MpiTasker : public AbstractTasker {
   llvm::StructType* AccessorType_ = nullptr;
   llvm::StructType* IndexSpaceType_ = nullptr;
   llvm::StructType* IndexPartitionType_ = nullptr;
+  llvm::StructType* FutureType_ = nullptr;
 
   llvm::Type* TaskInfoType_ = nullptr;
 
@@ -114,6 +115,8 @@ public:
       const std::vector<llvm::Type*> &,
       const std::vector<ReductionType> &) override;
 
+  virtual bool hasArrayReductions() const override { return true; }
+
   
   virtual llvm::AllocaInst* createPartition(
       llvm::Module &,
@@ -124,6 +127,11 @@ public:
       llvm::Module &,
       llvm::Value*,
       llvm::Value*) override;
+  virtual llvm::AllocaInst* createBlockPartition(
+      llvm::Module &,
+      llvm::Value*,
+      llvm::Value*,
+      llvm::Value*) override;
   
   virtual llvm::Type* getPartitionType(llvm::Type*) const override
   { return IndexPartitionType_; }
@@ -132,6 +140,13 @@ public:
   virtual bool isPartition(llvm::Value*) const override;
   virtual void destroyPartition(llvm::Module &, llvm::Value*) override;
   
+  virtual bool isFuture(llvm::Value*) const override;
+  virtual llvm::Value* loadFuture(
+      llvm::Module &,
+      llvm::Value*,
+      llvm::Type*) override;
+  virtual void destroyFuture(llvm::Module &, llvm::Value*) override;
+  
   virtual llvm::Type* getFieldType(llvm::Type*) const override
   { return FieldType_; }
 
@@ -177,6 +192,7 @@ protected:
   llvm::StructType* createFieldType();
   llvm::StructType* createAccessorType();
   llvm::StructType* createIndexPartitionType();
+  llvm::StructType* createFutureType();
 
   llvm::AllocaInst* createTaskInfo(llvm::Module &);
   void destroyTaskInfo(llvm::Module &, llvm::AllocaInst*);
@@ -1,9 +1,15 @@
+#include "blocks_rt.hpp"
 #include "mpi_rt.hpp"
+#include "reduce_rt.hpp"
 #include "librtmpi/mpi_utils.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <numeric>
 
 using namespace contra;
 
@@ -24,14 +30,683 @@ void mpi_runtime_t::check(int  errcode) {
     MPI_Abort(MPI_COMM_WORLD, errcode);
   }
 }
+
+//==============================================================================
+// Parse runtime options
+//==============================================================================
+void mpi_runtime_t::configure(int argc, const char ** argv) {
+  for (int i=1; i<argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-mpi:rma") {
+      UseRma = true;
+    }
+    else if (arg == "-mpi:shm") {
+      UseShm = true;
+    }
+    else if (arg.compare(0, 15, "-mpi:rebalance=") == 0) {
+      BalanceFrequency = std::stoul(arg.substr(15));
+    }
+    else if (arg.compare(0, 25, "-mpi:rebalance-threshold=") == 0) {
+      BalanceThreshold = std::stod(arg.substr(25));
+    }
+    else if (arg == "-mpi:stats") {
+      UseStats = true;
+    }
+    else if (arg.compare(0, 16, "-mpi:stats-json=") == 0) {
+      UseStats = true;
+      StatsFile = arg.substr(16);
+    }
+    else {
+      if (isRoot())
+        std::cerr << "Unknown MPI runtime option '" << arg << "'" << std::endl;
+      abort();
+    }
+  }
+
+  if (UseShm) setupNode();
+}
+
+//==============================================================================
+// Group the ranks that can share memory
+//==============================================================================
+void mpi_runtime_t::setupNode() {
+  auto ret = MPI_Comm_split_type(
+      MPI_COMM_WORLD,
+      MPI_COMM_TYPE_SHARED,
+      Rank,
+      MPI_INFO_NULL,
+      &NodeComm);
+  check(ret);
+
+  MPI_Group world_group, node_group;
+  ret = MPI_Comm_group(MPI_COMM_WORLD, &world_group);
+  check(ret);
+  ret = MPI_Comm_group(NodeComm, &node_group);
+  check(ret);
+
+  std::vector<int> world_ranks(Size);
+  std::iota(world_ranks.begin(), world_ranks.end(), 0);
+  NodeRanks.resize(Size);
+  ret = MPI_Group_translate_ranks(
+      world_group,
+      Size,
+      world_ranks.data(),
+      node_group,
+      NodeRanks.data());
+  check(ret);
+  for (auto & r : NodeRanks)
+    if (r == MPI_UNDEFINED) r = -1;
+
+  MPI_Group_free(&world_group);
+  MPI_Group_free(&node_group);
+}
+
+//==============================================================================
+// Make writes to shared field storage visible to the rest of the node
+//==============================================================================
+void mpi_runtime_t::syncNode() {
+  if (!UseShm) return;
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  auto ret = MPI_Barrier(NodeComm);
+  check(ret);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+//==============================================================================
+// Allocate field storage
+//==============================================================================
+void * mpi_runtime_t::allocate(size_t bytes) {
+  if (!UseShm) return malloc(bytes);
+
+  // every rank gets a distinct address, even when it holds no values
+  byte_t * base = nullptr;
+  MPI_Win win;
+  auto ret = MPI_Win_allocate_shared(
+      std::max<size_t>(bytes, 1),
+      1,
+      MPI_INFO_NULL,
+      NodeComm,
+      &base,
+      &win);
+  check(ret);
+
+  int node_size;
+  MPI_Comm_size(NodeComm, &node_size);
+
+  shared_segment_t segment;
+  segment.Id = SegmentCounter++;
+  segment.Win = win;
+  segment.Bases.resize(node_size);
+  for (int i=0; i<node_size; ++i) {
+    MPI_Aint size;
+    int disp_unit;
+    ret = MPI_Win_shared_query(win, i, &size, &disp_unit, &segment.Bases[i]);
+    check(ret);
+  }
+
+  SharedSegments.emplace(base, std::move(segment));
+  return base;
+}
+
+//==============================================================================
+// Free field storage
+//==============================================================================
+void mpi_runtime_t::deallocate(void * data) {
+  auto it = SharedSegments.find(data);
+  if (it == SharedSegments.end()) {
+    free(data);
+    return;
+  }
+  // freeing a window is collective, so it is deferred until all ranks of
+  // the node are known to have released the same segments
+  const auto & segment = it->second;
+  ReleasedSegments.emplace(segment.Id, segment.Win);
+  SharedSegments.erase(it);
+}
+
+//==============================================================================
+// Free released shared storage in allocation order
+//==============================================================================
+void mpi_runtime_t::releaseSegments() {
+  int finalized = 0;
+  MPI_Finalized(&finalized);
+  if (!finalized) {
+    for (auto & segment : ReleasedSegments) {
+      auto ret = MPI_Win_free(&segment.second);
+      check(ret);
+    }
+  }
+  ReleasedSegments.clear();
+}
+
+//==============================================================================
+// Redistribute index points from their measured costs
+//==============================================================================
+void mpi_runtime_t::rebalance(load_balance_t & Balance) {
+  Balance.Launches++;
+  if (Balance.Launches % BalanceFrequency) return;
+
+  const auto & dist = Balance.Dist;
+  std::vector<int> counts(Size), displs(Size);
+  for (int r=0; r<Size; ++r) {
+    counts[r] = dist[r+1] - dist[r];
+    displs[r] = dist[r];
+  }
+
+  auto num_points = dist[Size];
+  std::vector<double> costs(num_points);
+  auto ret = MPI_Allgatherv(
+      Balance.Costs.data(),
+      Balance.Costs.size(),
+      MPI_DOUBLE,
+      costs.data(),
+      counts.data(),
+      displs.data(),
+      MPI_DOUBLE,
+      MPI_COMM_WORLD);
+  check(ret);
+
+  std::fill(Balance.Costs.begin(), Balance.Costs.end(), 0);
+  
+  // only move points when the slowest rank is far enough behind
+  auto total = std::accumulate(costs.begin(), costs.end(), 0.);
+  double max_cost = 0;
+  for (int r=0; r<Size; ++r) {
+    auto begin = costs.begin() + dist[r];
+    auto end = costs.begin() + dist[r+1];
+    max_cost = std::max(max_cost, std::accumulate(begin, end, 0.));
+  }
+
+  auto avg_cost = total / Size;
+  if (avg_cost <= 0 || max_cost < BalanceThreshold*avg_cost) return;
+
+  // each point goes to the rank whose share of the prefix sum holds its
+  // midpoint
+  std::vector<int_t> new_dist(Size+1, 0);
+  double prefix = 0;
+  for (int_t p=0; p<num_points; ++p) {
+    auto mid = prefix + costs[p]/2;
+    auto r = std::min<int_t>(mid / avg_cost, Size-1);
+    new_dist[r+1]++;
+    prefix += costs[p];
+  }
+  for (int r=0; r<Size; ++r) new_dist[r+1] += new_dist[r];
+
+  Balance.Dist = new_dist;
+  Balance.Costs.assign(new_dist[Rank+1] - new_dist[Rank], 0);
+}
+
+//==============================================================================
+// Setup a field exchange
+//==============================================================================
+void field_exchange_t::setup(int_t recvsize, int_t reqsize, bool shared)
+{
+  auto buf = shared ? MpiRuntime.allocate(recvsize) : malloc(recvsize);
+  RecvBufs.emplace_back(buf);
+  Requests.reserve(reqsize);
+}
+
+//==============================================================================
+// Destroy a field exchange
+//==============================================================================
+field_exchange_t::~field_exchange_t() {
+  for (auto RecvBuf : RecvBufs)
+    if (RecvBuf) MpiRuntime.deallocate(RecvBuf);
+}
+
+//==============================================================================
+// Allocate a field's local storage
+//==============================================================================
+int_t contra_mpi_field_t::allocate(
+    contra_mpi_partition_t *part,
+    int_t *dist,
+    int_t rank,
+    int_t size)
+{
+  distribution = new int_t[size+1];
+  memcpy(distribution, dist, (size+1)*sizeof(int_t));
+
+  partition = new contra_mpi_partition_t;
+  *partition = *part;
+  
+  auto len = part->offsets[dist[rank+1]] - part->offsets[dist[rank]];
+  data = MpiRuntime.allocate(data_size*len);
+  return len;
+}
+
+//==============================================================================
+// Replace a field's local storage
+//==============================================================================
+void contra_mpi_field_t::transfer(void * buf) {
+  if (data) MpiRuntime.deallocate(data);
+  data = buf;
+}
+
+//==============================================================================
+// Release a field
+//==============================================================================
+void contra_mpi_field_t::destroy() {
+  if (data) MpiRuntime.deallocate(data);
+  data_size = 0;
+  data = nullptr;
+  index_space = nullptr;
+  id = -1;
+  if (distribution) delete[] distribution;
+  if (partition) delete partition;
+}
+
+//==============================================================================
+// Release the datatypes of an exchange plan
+//==============================================================================
+void indexed_plan_t::destroy() {
+  int finalized = 0;
+  MPI_Finalized(&finalized);
+  if (!finalized) {
+    for (auto & type : SendTypes) MPI_Type_free(&type);
+    for (auto & type : RecvTypes) MPI_Type_free(&type);
+    for (auto & type : TargetTypes) MPI_Type_free(&type);
+  }
+  Dist.clear();
+  FieldDist.clear();
+  SendRanks.clear();
+  RecvRanks.clear();
+  SendTypes.clear();
+  RecvTypes.clear();
+  TargetTypes.clear();
+  CopyRanks.clear();
+  CopyFrom.clear();
+  CopyTo.clear();
+  Ready.clear();
+  NumIndices = 0;
+}
+
+//==============================================================================
+// Wait on a field exchange
+//==============================================================================
+void mpi_runtime_t::wait(field_exchange_t & exchange) {
+  auto & requests = exchange.getRequests();
+  if (requests.empty()) return;
+  auto start = UseStats ? MPI_Wtime() : 0;
+  std::vector<MPI_Status> status(requests.size());
+  auto ret = MPI_Waitall(requests.size(), requests.data(), status.data());
+  check(ret);
+  requests.clear();
+  if (UseStats) {
+    auto elapsed = MPI_Wtime() - start;
+    if (exchange.FieldStats) exchange.FieldStats->WaitTime += elapsed;
+    if (exchange.LaunchStats) exchange.LaunchStats->WaitTime += elapsed;
+  }
+}
+
+//==============================================================================
+// Aggregate and print the communication statistics
+//==============================================================================
+void mpi_runtime_t::report() {
+  if (!UseStats) return;
+
+  // every rank registers the same fields and launches, so the values line up
+  std::vector<double> vals;
+  for (const auto & stats : FieldStats) stats.second.pack(vals);
+  for (const auto & stats : LaunchStats) stats.second.pack(vals);
+  vals.insert(vals.end(), {NumReductions, ReduceLatency, ReduceWait});
+
+  auto n = vals.size();
+  std::vector<double> mins(n), maxs(n), sums(n);
+  auto ret = MPI_Reduce(vals.data(), mins.data(), n, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+  check(ret);
+  ret = MPI_Reduce(vals.data(), maxs.data(), n, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  check(ret);
+  ret = MPI_Reduce(vals.data(), sums.data(), n, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  check(ret);
+
+  if (!isRoot()) return;
+
+  const std::vector<std::string> ExchangeLabels = {
+    "bytes_sent", "bytes_received", "messages_sent", "messages_received", "wait_time"};
+  const std::vector<std::string> ReduceLabels = {
+    "count", "latency", "wait_time"};
+
+  //------------------------------------
+  // human readable
+  std::cout << "MPI statistics (min / avg / max over " << Size << " ranks)" << std::endl;
+  
+  size_t pos = 0;
+  auto print = [&](const std::string & title, const auto & labels) {
+    std::cout << title << std::endl;
+    for (const auto & label : labels) {
+      std::cout << "  " << std::left << std::setw(18) << label << " "
+        << mins[pos] << " / " << sums[pos]/Size << " / " << maxs[pos] << std::endl;
+      pos++;
+    }
+  };
+
+  for (const auto & stats : FieldStats)
+    print("field '" + stats.first + "'", ExchangeLabels);
+  for (const auto & stats : LaunchStats)
+    print("launch '" + stats.first + "'", ExchangeLabels);
+  print("reductions", ReduceLabels);
+
+  //------------------------------------
+  // json
+  if (StatsFile.empty()) return;
+
+  std::ofstream out(StatsFile);
+  if (!out) {
+    std::cerr << "Unable to open '" << StatsFile << "' for MPI statistics" << std::endl;
+    return;
+  }
+  
+  pos = 0;
+  auto dump = [&](const auto & labels, const std::string & indent) {
+    out << "{" << std::endl;
+    for (size_t i=0; i<labels.size(); ++i, ++pos) {
+      out << indent << "  \"" << labels[i] << "\": {\"min\": " << mins[pos]
+        << ", \"avg\": " << sums[pos]/Size << ", \"max\": " << maxs[pos] << "}";
+      out << (i+1<labels.size() ? "," : "") << std::endl;
+    }
+    out << indent << "}";
+  };
+  auto dump_all = [&](const std::string & title, const auto & entries) {
+    out << "  \"" << title << "\": {" << std::endl;
+    size_t i = 0;
+    for (const auto & stats : entries) {
+      out << "    \"" << stats.first << "\": ";
+      dump(ExchangeLabels, "    ");
+      out << (++i<entries.size() ? "," : "") << std::endl;
+    }
+    out << "  }," << std::endl;
+  };
+
+  out << "{" << std::endl;
+  out << "  \"ranks\": " << Size << "," << std::endl;
+  dump_all("fields", FieldStats);
+  dump_all("launches", LaunchStats);
+  out << "  \"reductions\": ";
+  dump(ReduceLabels, "  ");
+  out << std::endl << "}" << std::endl;
+}
+
+//==============================================================================
+// Finish an indexed exchange plan
+//==============================================================================
+void finish_indexed_plan(
+    indexed_plan_t & Plan,
+    const int_t * dist,
+    contra_mpi_partition_t * part,
+    contra_mpi_field_t * fld,
+    size_t tot_indices)
+{
+  auto comm_rank = MpiRuntime.getRank();
+  auto comm_size = MpiRuntime.getSize();
+  auto dist_start = dist[comm_rank];
+  auto dist_end = dist[comm_rank+1];
+
+  // points that only read locally owned values do not need to wait
+  std::vector<bool> is_local(tot_indices, false);
+  for (auto loc : Plan.CopyTo) is_local[loc] = true;
+
+  auto index_offsets = part->indices->partition->offsets;
+  auto rank_start = part->indices->rank_begin(comm_rank);
+  Plan.Ready.assign(dist_end - dist_start, false);
+  for (auto p=dist_start; p<dist_end; ++p) {
+    auto begin = is_local.begin() + (index_offsets[p] - rank_start);
+    auto end = is_local.begin() + (index_offsets[p+1] - rank_start);
+    Plan.Ready[p-dist_start] = std::all_of(begin, end, [](bool b) { return b; });
+  }
+
+  auto field_dist = fld->distribution;
+  Plan.NumIndices = tot_indices;
+  Plan.Dist.assign(dist, dist+comm_size+1);
+  Plan.FieldDist.assign(field_dist, field_dist+comm_size+1);
+}
+
+//==============================================================================
+// Build a one-sided plan for fetching a field through an indexed partition
+//==============================================================================
+void build_rma_plan(
+    indexed_plan_t & Plan,
+    const int_t * dist,
+    contra_mpi_partition_t * part,
+    contra_mpi_field_t * fld)
+{
+  auto comm_rank = MpiRuntime.getRank();
+  auto comm_size = MpiRuntime.getSize();
+  
+  auto part_indices = static_cast<int_t*>(part->indices->data);
+  
+  auto field_part = fld->partition;
+  auto field_offset_start = field_part->offsets_begin();
+  auto field_offset_end = field_part->offsets_end();
+  auto field_dist = fld->distribution;
+  auto num_field_parts = field_part->num_parts;
+
+  std::vector<int_t> field_part_owners(num_field_parts);
+  for (decltype(comm_size) i=0; i<comm_size; ++i)
+    for (auto p=field_dist[i]; p<field_dist[i+1]; ++p)
+      field_part_owners[p] = i;
+
+  auto dist_start = dist[comm_rank];
+  auto local_dist = dist[comm_rank+1] - dist_start;
   
+  size_t tot_indices = 0;
+  for (int_t p=0; p<local_dist; ++p) 
+    tot_indices += part->size(dist_start + p);
+
+  // every owner and offset is known locally, so no indices are exchanged
+  std::vector< std::vector<int> > origin_displs(comm_size);
+  std::vector< std::vector<int> > target_displs(comm_size);
+
+  for (size_t i=0; i<tot_indices; ++i) {
+    auto it = std::upper_bound(field_offset_start, field_offset_end, part_indices[i]);
+    auto pid = std::distance(field_offset_start, it) - 1;
+    auto r = field_part_owners[pid];
+    auto disp = part_indices[i] - fld->rank_begin(r);
+    // values on this rank or node are copied directly
+    if (r == comm_rank || MpiRuntime.isOnNode(r)) {
+      Plan.CopyRanks.emplace_back(r);
+      Plan.CopyFrom.emplace_back(disp);
+      Plan.CopyTo.emplace_back(i);
+    }
+    else {
+      origin_displs[r].emplace_back(i);
+      target_displs[r].emplace_back(disp);
+    }
+  }
+
+  MPI_Datatype elem_t;
+  auto ret = MPI_Type_contiguous(fld->data_size, MPI_BYTE, &elem_t);
+  MpiRuntime.check(ret);
+
+  for (decltype(comm_size) i=0; i<comm_size; ++i) {
+    auto count = origin_displs[i].size();
+    if (count == 0) continue;
+    MPI_Datatype origin_t, target_t;
+    ret = MPI_Type_create_indexed_block(
+        count, 1, origin_displs[i].data(), elem_t, &origin_t);
+    MpiRuntime.check(ret);
+    ret = MPI_Type_commit(&origin_t);
+    MpiRuntime.check(ret);
+    ret = MPI_Type_create_indexed_block(
+        count, 1, target_displs[i].data(), elem_t, &target_t);
+    MpiRuntime.check(ret);
+    ret = MPI_Type_commit(&target_t);
+    MpiRuntime.check(ret);
+    Plan.RecvRanks.emplace_back(i);
+    Plan.RecvTypes.emplace_back(origin_t);
+    Plan.TargetTypes.emplace_back(target_t);
+  }
+
+  ret = MPI_Type_free(&elem_t);
+  MpiRuntime.check(ret);
+
+  finish_indexed_plan(Plan, dist, part, fld, tot_indices);
+}
+  
+
+//==============================================================================
+// Account for the traffic of a field exchange
+//==============================================================================
+void record_exchange(
+    field_exchange_t & Request,
+    contra_mpi_field_t * fld,
+    contra_mpi_task_info_t** info,
+    int_t bytes_sent,
+    int_t bytes_recvd,
+    int_t messages_sent,
+    int_t messages_recvd)
+{
+  Request.FieldStats = MpiRuntime.getRegisteredField(fld->id).Stats;
+  Request.LaunchStats = (*info)->Stats;
+  for (auto stats : {Request.FieldStats, Request.LaunchStats}) {
+    if (!stats) continue;
+    stats->BytesSent += bytes_sent;
+    stats->BytesRecvd += bytes_recvd;
+    stats->MessagesSent += messages_sent;
+    stats->MessagesRecvd += messages_recvd;
+  }
+}
+
+//==============================================================================
+// Move a field's values to a new contiguous partitioning
+//==============================================================================
+void redistribute_field(
+    contra_mpi_field_t * fld,
+    contra_mpi_partition_t * part,
+    int_t * dist,
+    contra_mpi_task_info_t** info)
+{
+  auto comm_rank = MpiRuntime.getRank();
+  auto comm_size = MpiRuntime.getSize();
+
+  auto part_offsets = part->offsets;
+  auto data_size = fld->data_size;
+  bool exchange = false;
+  
+  std::vector<int_t> sendcounts(comm_size, 0);
+  std::vector<int_t> recvcounts(comm_size, 0);
+  std::vector<int_t> sendpos(comm_size);
+  std::vector<int_t> recvpos(comm_size);
+  
+  auto comm_fld_begin = fld->rank_begin(comm_rank);
+  auto comm_fld_end = fld->rank_end(comm_rank);
+    
+  auto comm_part_begin = part_offsets[dist[comm_rank]];
+  auto comm_part_end = part_offsets[dist[comm_rank+1]];
+
+  int_t recvcnt = 0;
+  for (decltype(comm_size) i=0; i<comm_size; ++i) {
+    // send
+    auto begin = std::max(comm_fld_begin, part_offsets[dist[i]]);
+    auto end = std::min(comm_fld_end, part_offsets[dist[i+1]]);
+    sendpos[i] = (begin - comm_fld_begin) * data_size;
+    sendcounts[i] = end>begin ? (end-begin) * data_size : 0;
+    // recv
+    begin = std::max(fld->rank_begin(i), comm_part_begin);
+    end = std::min(fld->rank_end(i), comm_part_end);
+    recvpos[i] = (begin - fld->rank_begin(i)) * data_size;
+    recvcounts[i] = end>begin ? (end-begin) * data_size : 0;
+    recvcnt += recvcounts[i];
+    if (i!=comm_rank && (sendcounts[i] || recvcounts[i])) exchange = true;
+  }
+    
+  // shared storage is allocated and freed by the whole node together
+  if (MpiRuntime.useShm()) exchange = true;
+  MpiRuntime.syncNode();
+    
+  //------------------------------------
+  // at least some info must be exchanged
+  if  (exchange) {
+
+    auto fld_data = static_cast<byte_t*>(fld->data);
+  
+    auto & Request = MpiRuntime.requestField(fld_data, recvcnt, 2*comm_size, true);
+    Request.ReplacesData = true;
+
+    auto recvbuf = static_cast<byte_t*>(Request.getBuffer());
+    auto & requests = Request.getRequests();
+   
+    int tag = 0;
+    auto mpi_byte_t = librtmpi::typetraits<byte_t>::type();
+
+    recvcnt = 0;
+    int_t remote_recvcnt = 0;
+    int_t num_recvs = 0;
+    for (decltype(comm_size) i=0; i<comm_size; ++i) {
+      auto count = recvcounts[i];
+      if(count > 0) {
+        auto buf = &recvbuf[recvcnt];
+        // data this rank already has is copied right away
+        if (i == comm_rank) {
+          memcpy(buf, fld_data + sendpos[i], count);
+        }
+        // as is data held elsewhere on the node
+        else if (MpiRuntime.isOnNode(i)) {
+          auto src = MpiRuntime.getNodePointer(fld_data, i);
+          memcpy(buf, src + recvpos[i], count);
+        }
+        else {
+          requests.emplace_back();
+          auto & my_request = requests.back();
+          auto ret = MPI_Irecv(buf, count, mpi_byte_t, i, tag, MPI_COMM_WORLD, &my_request);
+          MpiRuntime.check(ret);
+          remote_recvcnt += count;
+          num_recvs++;
+        }
+        recvcnt += count;
+      }
+    }
+  
+    int_t sendcnt = 0;
+    for (decltype(comm_size) i=0; i<comm_size; ++i) {
+      auto count = sendcounts[i];
+      if(count > 0 && i != comm_rank && !MpiRuntime.isOnNode(i)) {
+        auto buf = fld_data + sendpos[i];
+        requests.emplace_back();
+        auto & my_request = requests.back();
+        auto ret = MPI_Isend(buf, count, mpi_byte_t, i, tag, MPI_COMM_WORLD, &my_request);
+        MpiRuntime.check(ret);
+        sendcnt += count;
+      }
+    }
+
+    auto num_sends = requests.size() - num_recvs;
+    record_exchange(Request, fld, info, sendcnt, remote_recvcnt, num_sends, num_recvs);
+
+    // points whose data was all copied directly do not need to wait
+    auto dist_start = dist[comm_rank];
+    auto dist_end = dist[comm_rank+1];
+    Request.setReady(dist_start, dist_end - dist_start);
+    for (auto p=dist_start; p<dist_end; ++p) {
+      auto is_ready = true;
+      for (decltype(comm_size) i=0; i<comm_size && is_ready; ++i) {
+        auto overlaps = fld->rank_begin(i) < part_offsets[p+1] &&
+          fld->rank_end(i) > part_offsets[p];
+        if (overlaps && i != comm_rank && !MpiRuntime.isOnNode(i))
+          is_ready = false;
+      }
+      Request.Ready[p-dist_start] = is_ready;
+    }
+
+    (*info)->register_field(fld);
+  }
+  // done excanghe
+  //------------------------------------
+  
+  MpiRuntime.syncNode();
+  
+  // the new partition is held before the old one is released, since they
+  // may be the same
+  MpiRuntime.incrementPartition(part->id);
+  contra_mpi_partition_destroy(fld->partition);
+  fld->redistribute(part, dist, comm_size);
+}
 
 extern "C" {
   
 //==============================================================================
 /// startup runtime
 //==============================================================================
-void contra_mpi_init()
+void contra_mpi_init(int argc, const char ** argv)
 { 
   int rank;
   auto err = MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -42,8 +717,15 @@ void contra_mpi_init()
   MpiRuntime.check(err);
 
   MpiRuntime.setup(rank, size);
+  MpiRuntime.configure(argc, argv);
 }
 
+//==============================================================================
+/// shutdown runtime
+//==============================================================================
+void contra_mpi_finalize()
+{ MpiRuntime.report(); }
+
 //==============================================================================
 /// mark we are in a task
 //==============================================================================
@@ -82,20 +764,43 @@ void contra_mpi_loop_bounds(
     int_t * start,
     int_t * end,
     int_t * step,
-    int_t * dist)
+    int_t * dist,
+    const char * name,
+    contra_mpi_task_info_t** info)
 {
   int_t comm_size = MpiRuntime.getSize();
   int_t comm_rank = MpiRuntime.getRank();
 
   auto size = is->size();
-  auto chunk = size / comm_size;
-  auto remain = size % comm_size;
 
-  dist[0] = 0;
+  if (MpiRuntime.useStats())
+    (*info)->Stats = &MpiRuntime.getLaunchStats(name);
   
-  for (int_t i=0; i<comm_size; ++i) {
-    dist[i+1] = dist[i] + chunk;
-    if (i < remain) dist[i+1]++;
+  // repeated launches reuse the distribution from their measured costs
+  load_balance_t * balance = nullptr;
+  if (MpiRuntime.useBalance()) {
+    balance = &MpiRuntime.getLoadBalance(name, size);
+    (*info)->Balance = balance;
+  }
+
+  if (balance && !balance->Dist.empty()) {
+    std::copy(balance->Dist.begin(), balance->Dist.end(), dist);
+  }
+  else {
+    auto chunk = size / comm_size;
+    auto remain = size % comm_size;
+
+    dist[0] = 0;
+    
+    for (int_t i=0; i<comm_size; ++i) {
+      dist[i+1] = dist[i] + chunk;
+      if (i < remain) dist[i+1]++;
+    }
+
+    if (balance) {
+      balance->Dist.assign(dist, dist+comm_size+1);
+      balance->Costs.assign(dist[comm_rank+1] - dist[comm_rank], 0);
+    }
   }
   
   *step = is->step;
@@ -103,6 +808,68 @@ void contra_mpi_loop_bounds(
   *end = dist[comm_rank+1] * is->step;
 }
 
+//==============================================================================
+/// Order the index points so those with only local data run first
+//==============================================================================
+void contra_mpi_loop_schedule(
+    contra_mpi_task_info_t** info,
+    int_t start,
+    int_t end,
+    int_t step)
+{
+  std::vector<field_exchange_t*> exchanges;
+  for (auto fld : (*info)->FieldsFetched) {
+    auto res = MpiRuntime.findFieldRequest(fld->data);
+    if (res.second) exchanges.emplace_back(res.first);
+  }
+
+  auto & schedule = (*info)->Schedule;
+  schedule.clear();
+  (*info)->ScheduleStart = start;
+  (*info)->ScheduleStep = step;
+
+  std::vector<int_t> remote;
+  for (auto i=start; i<end; i+=step) {
+    auto is_ready = std::all_of(
+        exchanges.begin(),
+        exchanges.end(),
+        [=](auto exchange) { return exchange->isReady(i); });
+    if (is_ready) schedule.emplace_back(i);
+    else remote.emplace_back(i);
+  }
+  schedule.insert(schedule.end(), remote.begin(), remote.end());
+}
+
+//==============================================================================
+/// Get the scheduled index point
+//==============================================================================
+int_t contra_mpi_loop_index(
+    contra_mpi_task_info_t** info,
+    int_t i)
+{
+  auto pos = (i - (*info)->ScheduleStart) / (*info)->ScheduleStep;
+  return (*info)->Schedule[pos];
+}
+
+//==============================================================================
+/// Start timing an index point
+//==============================================================================
+void contra_mpi_point_start(contra_mpi_task_info_t** info)
+{
+  if ((*info)->Balance) (*info)->PointStart = MPI_Wtime();
+}
+
+//==============================================================================
+/// Stop timing an index point
+//==============================================================================
+void contra_mpi_point_stop(contra_mpi_task_info_t** info, int_t i)
+{
+  auto balance = (*info)->Balance;
+  if (!balance) return;
+  auto pos = (i - (*info)->ScheduleStart) / (*info)->ScheduleStep;
+  balance->Costs[pos] += MPI_Wtime() - (*info)->PointStart;
+}
+
 //==============================================================================
 /// create partition info
 //==============================================================================
@@ -113,7 +880,14 @@ void contra_mpi_task_info_create(contra_mpi_task_info_t** info)
 // destroy partition info
 //==============================================================================
 void contra_mpi_task_info_destroy(contra_mpi_task_info_t** info)
-{ delete (*info); }
+{
+  // finish exchanges that were only touched by local index points
+  for (auto fld : (*info)->FieldsFetched)
+    contra_mpi_field_complete(fld);
+  MpiRuntime.releaseSegments();
+  if ((*info)->Balance) MpiRuntime.rebalance(*(*info)->Balance);
+  delete (*info);
+}
 
 //==============================================================================
 // destroy partition info
@@ -136,7 +910,7 @@ void contra_mpi_field_create(
     contra_index_space_t * is,
     contra_mpi_field_t * fld)
 {
-  auto fid = MpiRuntime.registerField(data_size, init);
+  auto fid = MpiRuntime.registerField(name, data_size, init);
   fld->setup(is, data_size, fid);
 }
 
@@ -147,7 +921,8 @@ void contra_mpi_field_fetch(
     contra_index_space_t * is,
     int_t * dist,
     contra_mpi_partition_t * part,
-    contra_mpi_field_t * fld)
+    contra_mpi_field_t * fld,
+    contra_mpi_task_info_t** info)
 {
   auto & Field = MpiRuntime.getRegisteredField(fld->id);
   auto comm_rank = MpiRuntime.getRank();
@@ -157,268 +932,276 @@ void contra_mpi_field_fetch(
   // allocated somewhere
   if (fld->is_allocated()) {
 
-    auto is_same = fld->partition->id == part->id;
+    auto is_same = fld->partition->id == part->id &&
+      std::equal(dist, dist+comm_size+1, fld->distribution);
     
     if (!is_same && !part->indices) {
-      auto part_offsets = part->offsets;
-      auto data_size = fld->data_size;
-      bool exchange = false;
-      
-      std::vector<int_t> sendcounts(comm_size, 0);
-      std::vector<int_t> recvcounts(comm_size, 0);
-      std::vector<int_t> sendpos(comm_size);
-      
-      auto comm_fld_begin = fld->rank_begin(comm_rank);
-      auto comm_fld_end = fld->rank_end(comm_rank);
-        
-      auto comm_part_begin = part_offsets[dist[comm_rank]];
-      auto comm_part_end = part_offsets[dist[comm_rank+1]];
-
-      int_t recvcnt = 0;
-      for (decltype(comm_size) i=0; i<comm_size; ++i) {
-        // send
-        auto begin = std::max(comm_fld_begin, part_offsets[dist[i]]);
-        auto end = std::min(comm_fld_end, part_offsets[dist[i+1]]);
-        sendpos[i] = (begin - comm_fld_begin) * data_size;
-        sendcounts[i] = end>begin ? (end-begin) * data_size : 0;
-        // recv
-        begin = std::max(fld->rank_begin(i), comm_part_begin);
-        end = std::min(fld->rank_end(i), comm_part_end);
-        recvcounts[i] = end>begin ? (end-begin) * data_size : 0;
-        recvcnt += recvcounts[i];
-        if (i!=comm_rank && (sendcounts[i] || recvcounts[i])) exchange = true;
-      }
-        
-      //------------------------------------
-      // at least some info must be exchanged
-      if  (exchange) {
-
-        auto fld_data = static_cast<byte_t*>(fld->data);
-      
-        auto & Request = MpiRuntime.requestField(fld_data, recvcnt, 2*comm_size);
-
-        auto recvbuf = static_cast<byte_t*>(Request.getBuffer());
-        auto & requests = Request.getRequests();
-       
-        int tag = 0;
-        auto mpi_byte_t = librtmpi::typetraits<byte_t>::type();
-
-        recvcnt = 0;
-        for (decltype(comm_size) i=0; i<comm_size; ++i) {
-          auto count = recvcounts[i];
-          if(count > 0) {
-            auto buf = &recvbuf[recvcnt];
-            requests.emplace_back();
-            auto & my_request = requests.back();
-            auto ret = MPI_Irecv(buf, count, mpi_byte_t, i, tag, MPI_COMM_WORLD, &my_request);
-            MpiRuntime.check(ret);
-          recvcnt += count;
-          }
-        }
-      
-        int_t sendcnt = 0;
-        for (decltype(comm_size) i=0; i<comm_size; ++i) {
-          auto count = sendcounts[i];
-          if(count > 0) {
-            auto buf = fld_data + sendpos[i];
-            requests.emplace_back();
-            auto & my_request = requests.back();
-            auto ret = MPI_Isend(buf, count, mpi_byte_t, i, tag, MPI_COMM_WORLD, &my_request);
-            MpiRuntime.check(ret);
-            sendcnt += count;
-          }
-        }
-
-      }
-      // done excanghe
-      //------------------------------------
-      
-      contra_mpi_partition_destroy(fld->partition);
-      fld->redistribute(part, dist, comm_size);
-      MpiRuntime.incrementPartition(part->id);
-      
+      redistribute_field(fld, part, dist, info);
     } // ! is_same
     else if (!is_same && part->indices) {
       
       //------------------------------------
       // check if partition needs exchange
     
-      // figure out which indices i have
-      auto num_parts = part->num_parts;
-      auto current_dist = part->indices->distribution;
-
-      if (!std::equal(current_dist, current_dist+num_parts, dist)) {
-
-        auto first_part = current_dist[comm_rank];
-        auto last_part = current_dist[comm_rank+1];
-
-        auto int_size = sizeof(int_t);
-        
-        std::vector<int_t> sendcounts(comm_size, 0);
-        std::vector<int_t> recvcounts(comm_size, 0);
-
-        bool exchange = false;
+      // the indices follow the launch distribution
+      auto indices = part->indices;
+      auto current_dist = indices->distribution;
 
-        for (decltype(comm_size) i=0; i<comm_size; ++i) {
-          auto begin = std::max(dist[i], first_part);
-          auto end = std::min(dist[i+1], last_part);
-          begin = part->offsets[begin];
-          end = part->offsets[end];
-          sendcounts[i] = end>begin ? (end-begin) * int_size : 0;
-          begin = std::max(dist[comm_rank], current_dist[i]);
-          end = std::min(dist[comm_rank+1], current_dist[i+1]);
-          begin = part->offsets[begin];
-          end = part->offsets[end];
-          recvcounts[i] = end>begin ? (end-begin) * int_size : 0;
-          if (i!=comm_rank && (sendcounts[i] || recvcounts[i])) exchange = true;
-        }
-        
-        //------------------------------------
-        // at least some info must be exchanged
-        if  (exchange) {
-          std::cerr << "redistribution of partition from field not implemented" << std::endl;
-          abort();
-        }
+      if (!std::equal(current_dist, current_dist+comm_size+1, dist)) {
+        redistribute_field(indices, indices->partition, dist, info);
+        contra_mpi_field_complete(indices);
       }
   
       //------------------------------------
-      // Now fetch values
-      
-      auto part_indices = static_cast<int_t*>(part->indices->data);
+      // Build the exchange plan if it is not cached
       
-      auto field_part = fld->partition;
-      auto field_offset_start = field_part->offsets_begin();
-      auto field_offset_end = field_part->offsets_end();
+      auto data_size = fld->data_size;
       auto field_dist = fld->distribution;
-      auto num_field_parts = field_part->num_parts;
-
-      std::vector<int_t> field_part_owners(num_field_parts);
-      for (decltype(comm_size) i=0; i<comm_size; ++i)
-        for (auto p=field_dist[i]; p<field_dist[i+1]; ++p)
-          field_part_owners[p] = i;
 
       auto dist_start = dist[comm_rank];
       auto dist_end = dist[comm_rank+1];
       auto local_dist = dist_end - dist_start;
+
+      auto & Plan = MpiRuntime.getIndexedPlan(
+          part->id,
+          fld->partition->id,
+          data_size);
+
+      auto rebuild = !Plan.matches(dist, field_dist, comm_size);
       
-      size_t tot_indices = 0;
-      for (int_t p=0; p<local_dist; ++p) 
-        tot_indices += part->size(dist_start + p);
-
-      std::vector<unsigned> index_owners;
-      index_owners.reserve(tot_indices);
-
-      std::vector<int_t> sendcounts(comm_size, 0);
-      for (size_t i=0; i<tot_indices; ++i) {
-        auto it = std::upper_bound(field_offset_start, field_offset_end, part_indices[i]);
-        auto pid = std::distance(field_offset_start, it) - 1;
-        auto r = field_part_owners[pid];
-        sendcounts[r]++;
-        index_owners.emplace_back(r);
+      if (rebuild && MpiRuntime.useRma()) {
+        Plan.destroy();
+        build_rma_plan(Plan, dist, part, fld);
       }
-      
-      std::vector<int_t> senddispls(comm_size+1);
-      senddispls[0] = 0;
-      for(decltype(comm_size) r = 0; r < comm_size; ++r)
-        senddispls[r + 1] = senddispls[r] + sendcounts[r];
+      else if (rebuild) {
 
-      std::vector<int_t> send_indices(senddispls[comm_size]);
-      std::fill(sendcounts.begin(), sendcounts.end(), 0);
+        Plan.destroy();
       
-      std::vector<int_t> recvloc(tot_indices);
-      for (size_t i=0; i<tot_indices; ++i) {
-        auto r = index_owners[i];
-        auto pos = senddispls[r] + sendcounts[r];
-        send_indices[pos] = part_indices[i];
-        sendcounts[r]++;
-        recvloc[pos] = i;
-      }
+        auto part_indices = static_cast<int_t*>(part->indices->data);
+        
+        auto field_part = fld->partition;
+        auto field_offset_start = field_part->offsets_begin();
+        auto field_offset_end = field_part->offsets_end();
+        auto num_field_parts = field_part->num_parts;
+
+        std::vector<int_t> field_part_owners(num_field_parts);
+        for (decltype(comm_size) i=0; i<comm_size; ++i)
+          for (auto p=field_dist[i]; p<field_dist[i+1]; ++p)
+            field_part_owners[p] = i;
+
+        size_t tot_indices = 0;
+        for (int_t p=0; p<local_dist; ++p) 
+          tot_indices += part->size(dist_start + p);
 
-      auto mpi_int_t = librtmpi::typetraits<int_t>::type();
-      std::vector<int_t> recvcounts(comm_size, 0);
-
-      auto ret = MPI_Alltoall(
-          sendcounts.data(),
-          1,
-          mpi_int_t,
-          recvcounts.data(),
-          1,
-          mpi_int_t,
-          MPI_COMM_WORLD);
-      MpiRuntime.check(ret);
+        std::vector<unsigned> index_owners;
+        index_owners.reserve(tot_indices);
+
+        std::vector<int_t> sendcounts(comm_size, 0);
+        for (size_t i=0; i<tot_indices; ++i) {
+          auto it = std::upper_bound(field_offset_start, field_offset_end, part_indices[i]);
+          auto pid = std::distance(field_offset_start, it) - 1;
+          auto r = field_part_owners[pid];
+          sendcounts[r]++;
+          index_owners.emplace_back(r);
+        }
+        
+        std::vector<int_t> senddispls(comm_size+1);
+        senddispls[0] = 0;
+        for(decltype(comm_size) r = 0; r < comm_size; ++r)
+          senddispls[r + 1] = senddispls[r] + sendcounts[r];
+
+        std::vector<int_t> send_indices(senddispls[comm_size]);
+        std::fill(sendcounts.begin(), sendcounts.end(), 0);
+        
+        std::vector<int_t> recvloc(tot_indices);
+        for (size_t i=0; i<tot_indices; ++i) {
+          auto r = index_owners[i];
+          auto pos = senddispls[r] + sendcounts[r];
+          send_indices[pos] = part_indices[i];
+          sendcounts[r]++;
+          recvloc[pos] = i;
+        }
+
+        auto mpi_int_t = librtmpi::typetraits<int_t>::type();
+        std::vector<int_t> recvcounts(comm_size, 0);
+
+        auto ret = MPI_Alltoall(
+            sendcounts.data(),
+            1,
+            mpi_int_t,
+            recvcounts.data(),
+            1,
+            mpi_int_t,
+            MPI_COMM_WORLD);
+        MpiRuntime.check(ret);
+        
+        std::vector<int_t> recvdispls(comm_size+1);
+        recvdispls[0] = 0;
+        for(decltype(comm_size) r = 0; r < comm_size; ++r)
+          recvdispls[r + 1] = recvdispls[r] + recvcounts[r];
+
+        std::vector<int_t> recv_indices(recvdispls[comm_size]);
+        ret = librtmpi::alltoallv(
+            send_indices,
+            sendcounts,
+            senddispls,
+            recv_indices,
+            recvcounts,
+            recvdispls,
+            MPI_COMM_WORLD);
+        MpiRuntime.check(ret);
+
+        // recvloc maps the order values arrive in to their local index
+        std::swap(send_indices, recv_indices);
+        std::swap(sendcounts, recvcounts);
+        std::swap(senddispls, recvdispls);
+        
+        // the datatypes gather and scatter straight from field memory and
+        // into local index order
+        MPI_Datatype elem_t;
+        ret = MPI_Type_contiguous(data_size, MPI_BYTE, &elem_t);
+        MpiRuntime.check(ret);
+        
+        auto field_id_start = fld->rank_begin(comm_rank);
+        std::vector<int> displs;
+
+        for (decltype(comm_size) i=0; i<comm_size; ++i) {
+          auto count = recvcounts[i];
+          if (count == 0 || i == comm_rank) continue;
+          // values on the same node are read from the owner's storage
+          if (MpiRuntime.isOnNode(i)) {
+            auto owner_start = fld->rank_begin(i);
+            for (auto j=recvdispls[i]; j<recvdispls[i+1]; ++j) {
+              Plan.CopyRanks.emplace_back(i);
+              Plan.CopyFrom.emplace_back( recv_indices[j] - owner_start );
+              Plan.CopyTo.emplace_back( recvloc[j] );
+            }
+            continue;
+          }
+          displs.assign(
+              recvloc.begin() + recvdispls[i],
+              recvloc.begin() + recvdispls[i+1]);
+          MPI_Datatype recv_t;
+          ret = MPI_Type_create_indexed_block(count, 1, displs.data(), elem_t, &recv_t);
+          MpiRuntime.check(ret);
+          ret = MPI_Type_commit(&recv_t);
+          MpiRuntime.check(ret);
+          Plan.RecvRanks.emplace_back(i);
+          Plan.RecvTypes.emplace_back(recv_t);
+        }
+
+        for (decltype(comm_size) i=0; i<comm_size; ++i) {
+          auto count = sendcounts[i];
+          if (count == 0 || MpiRuntime.isOnNode(i)) continue;
+          auto indice_start = senddispls[i];
+          // values this rank already has are copied directly
+          if (i == comm_rank) {
+            for (int_t j=0; j<count; ++j) {
+              Plan.CopyRanks.emplace_back(i);
+              Plan.CopyFrom.emplace_back( send_indices[indice_start + j] - field_id_start );
+              Plan.CopyTo.emplace_back( recvloc[recvdispls[i] + j] );
+            }
+            continue;
+          }
+          displs.resize(count);
+          for (int_t j=0; j<count; ++j)
+            displs[j] = send_indices[indice_start + j] - field_id_start;
+          MPI_Datatype send_t;
+          ret = MPI_Type_create_indexed_block(count, 1, displs.data(), elem_t, &send_t);
+          MpiRuntime.check(ret);
+          ret = MPI_Type_commit(&send_t);
+          MpiRuntime.check(ret);
+          Plan.SendRanks.emplace_back(i);
+          Plan.SendTypes.emplace_back(send_t);
+        }
+        
+        ret = MPI_Type_free(&elem_t);
+        MpiRuntime.check(ret);
+
+        finish_indexed_plan(Plan, dist, part, fld, tot_indices);
+      }
       
-      std::vector<int_t> recvdispls(comm_size+1);
-      recvdispls[0] = 0;
-      for(decltype(comm_size) r = 0; r < comm_size; ++r)
-        recvdispls[r + 1] = recvdispls[r] + recvcounts[r];
-
-      std::vector<int_t> recv_indices(recvdispls[comm_size]);
-      ret = librtmpi::alltoallv(
-          send_indices,
-          sendcounts,
-          senddispls,
-          recv_indices,
-          recvcounts,
-          recvdispls,
-          MPI_COMM_WORLD);
-      MpiRuntime.check(ret);
-
-      std::swap(send_indices, recv_indices);
-      std::swap(sendcounts, recvcounts);
-      std::swap(senddispls, recvdispls);
+      //------------------------------------
+      // Now fetch values
       
-      // now exchange field data
       auto field_data = static_cast<byte_t*>(fld->data);
-      auto data_size = fld->data_size;
       
       auto & Request = MpiRuntime.requestField(
           field_data,
-          senddispls[comm_size] * data_size,
-          recvdispls[comm_size] * data_size,
-          2*comm_size);
+          Plan.NumIndices * data_size,
+          Plan.SendRanks.size() + Plan.RecvRanks.size());
       
-      std::swap(Request.Locations, recvloc);
-
-      auto sendbuf = static_cast<byte_t*>(Request.getBuffer(0));
-      auto recvbuf = static_cast<byte_t*>(Request.getBuffer(1));
+      auto recvbuf = static_cast<byte_t*>(Request.getBuffer());
       auto & requests = Request.getRequests();
       
-      int tag = 0;
-      auto mpi_byte_t = librtmpi::typetraits<byte_t>::type();
-
-      size_t recvcnt = 0;
-      for (decltype(comm_size) i=0; i<comm_size; ++i) {
-        auto count = recvcounts[i] * data_size;
-        if(count > 0) {
-          auto buf = &recvbuf[recvcnt];
+      // one-sided: expose the local values and pull only what is needed
+      if (MpiRuntime.useRma()) {
+        auto local_size = fld->rank_end(comm_rank) - fld->rank_begin(comm_rank);
+        auto ret = MPI_Win_create(field_data, local_size*data_size, data_size,
+            MPI_INFO_NULL, MPI_COMM_WORLD, &Request.Win);
+        MpiRuntime.check(ret);
+        ret = MPI_Win_lock_all(0, Request.Win);
+        MpiRuntime.check(ret);
+        for (size_t i=0; i<Plan.RecvRanks.size(); ++i) {
           requests.emplace_back();
           auto & my_request = requests.back();
-          auto ret = MPI_Irecv(buf, count, mpi_byte_t, i, tag, MPI_COMM_WORLD, &my_request);
+          ret = MPI_Rget(recvbuf, 1, Plan.RecvTypes[i], Plan.RecvRanks[i],
+              0, 1, Plan.TargetTypes[i], Request.Win, &my_request);
           MpiRuntime.check(ret);
-        recvcnt += count;
         }
       }
-      
-      auto field_id_start = fld->rank_begin(comm_rank);
-      int_t sendcnt = 0;
-      for (decltype(comm_size) i=0; i<comm_size; ++i) {
-        auto count = sendcounts[i] * data_size;
-        if(count > 0) {
-          auto buf = &sendbuf[sendcnt];
-          auto indice_start = senddispls[i];
-          for (int_t j=0; j<sendcounts[i]; ++j) {
-            auto pos = send_indices[ indice_start + j ] - field_id_start;
-            pos *= data_size;
-            memcpy(buf + j*data_size, field_data + pos, data_size); 
-          }
+      // two-sided: matching sends and receives
+      else {
+        int tag = 0;
+
+        for (size_t i=0; i<Plan.RecvRanks.size(); ++i) {
+          requests.emplace_back();
+          auto & my_request = requests.back();
+          auto ret = MPI_Irecv(recvbuf, 1, Plan.RecvTypes[i], Plan.RecvRanks[i],
+              tag, MPI_COMM_WORLD, &my_request);
+          MpiRuntime.check(ret);
+        }
+        
+        for (size_t i=0; i<Plan.SendRanks.size(); ++i) {
           requests.emplace_back();
           auto & my_request = requests.back();
-          auto ret = MPI_Isend(buf, count, mpi_byte_t, i, tag, MPI_COMM_WORLD, &my_request);
+          auto ret = MPI_Isend(field_data, 1, Plan.SendTypes[i], Plan.SendRanks[i],
+              tag, MPI_COMM_WORLD, &my_request);
           MpiRuntime.check(ret);
-          sendcnt += count;
         }
       }
 
+      int_t bytes_sent = 0;
+      int_t bytes_recvd = 0;
+      for (auto type : Plan.SendTypes) {
+        int size;
+        MPI_Type_size(type, &size);
+        bytes_sent += size;
+      }
+      for (auto type : Plan.RecvTypes) {
+        int size;
+        MPI_Type_size(type, &size);
+        bytes_recvd += size;
+      }
+      record_exchange(Request, fld, info, bytes_sent, bytes_recvd,
+          Plan.SendRanks.size(), Plan.RecvRanks.size());
+
+      MpiRuntime.syncNode();
+      for (size_t i=0; i<Plan.CopyFrom.size(); ++i) {
+        auto r = Plan.CopyRanks[i];
+        auto base = r == comm_rank ?
+          field_data : MpiRuntime.getNodePointer(field_data, r);
+        auto dest = recvbuf + Plan.CopyTo[i]*data_size;
+        auto src = base + Plan.CopyFrom[i]*data_size;
+        memcpy(dest, src, data_size);
+      }
+      MpiRuntime.syncNode();
+
+      Request.ReadyStart = dist_start;
+      Request.Ready = Plan.Ready;
+      
+      (*info)->register_field(fld);
+
     }
 
   }
@@ -436,6 +1219,29 @@ void contra_mpi_field_fetch(
   }
 }
 
+//==============================================================================
+// Finish any outstanding exchange for a field
+//==============================================================================
+void contra_mpi_field_complete(contra_mpi_field_t * fld)
+{
+  auto key = fld->data;
+  auto res = MpiRuntime.findFieldRequest(key);
+  if (!res.second) return;
+  
+  auto & exchange_data = *res.first;
+  MpiRuntime.wait(exchange_data);
+
+  if (exchange_data.Win != MPI_WIN_NULL) {
+    auto ret = MPI_Win_unlock_all(exchange_data.Win);
+    MpiRuntime.check(ret);
+    ret = MPI_Win_free(&exchange_data.Win);
+    MpiRuntime.check(ret);
+  }
+  if (exchange_data.ReplacesData)
+    fld->transfer( exchange_data.transferBuffer() );
+  MpiRuntime.eraseFieldRequest(key);
+}
+
 //==============================================================================
 // Destroy a field
 //==============================================================================
@@ -443,6 +1249,7 @@ void contra_mpi_field_destroy(contra_mpi_field_t * fld)
 {
   if (fld->partition) contra_mpi_partition_destroy(fld->partition);
   fld->destroy();
+  MpiRuntime.releaseSegments();
 }
 
 //==============================================================================
@@ -536,6 +1343,78 @@ void contra_mpi_partition_from_array(
   //------------------------------------
 }
 
+//==============================================================================
+/// block partition of a row-major index space
+//==============================================================================
+void contra_mpi_partition_from_blocks(
+    dopevector_t * dims_arr,
+    dopevector_t * blocks_arr,
+    contra_index_space_t * is,
+    contra_mpi_partition_t * part)
+{
+  int_t num_parts;
+  int_t * indices;
+  int_t * offsets;
+  contra::blockPartition(
+      static_cast<const int_t*>(dims_arr->data),
+      dims_arr->size,
+      static_cast<const int_t*>(blocks_arr->data),
+      blocks_arr->size,
+      is->size(),
+      num_parts,
+      indices,
+      offsets);
+
+  int_t comm_size = MpiRuntime.getSize();
+  int_t comm_rank = MpiRuntime.getRank();
+  
+  // the indices are stored in a field split along the blocks
+  auto idx_is = new contra_index_space_t;
+  idx_is->setup(0, is->size());
+  
+  auto idx_fld = new contra_mpi_field_t;
+  contra_mpi_field_create("blocks", sizeof(int_t), nullptr, idx_is, idx_fld);
+
+  auto idx_offsets = new int_t[num_parts+1];
+  std::copy(offsets, offsets+num_parts+1, idx_offsets);
+  
+  contra_mpi_partition_t idx_part;
+  auto idx_pid = MpiRuntime.registerPartition();
+  idx_part.setup(is->size(), num_parts, idx_is, idx_offsets, idx_pid);
+
+  // each rank holds the indices of a contiguous range of blocks
+  std::vector<int_t> dist(comm_size+1);
+  auto chunk = num_parts / comm_size;
+  auto remain = num_parts % comm_size;
+  dist[0] = 0;
+  for (int_t i=0; i<comm_size; ++i) {
+    dist[i+1] = dist[i] + chunk;
+    if (i < remain) dist[i+1]++;
+  }
+
+  auto len = idx_fld->allocate(&idx_part, dist.data(), comm_rank, comm_size);
+  auto first = indices + offsets[dist[comm_rank]];
+  std::copy(first, first+len, static_cast<int_t*>(idx_fld->data));
+  delete[] indices;
+
+  auto pid = MpiRuntime.registerPartition();
+  MpiRuntime.registerBlockIndices(pid, idx_fld);
+  part->setup(len, num_parts, is, idx_fld, offsets, pid);
+}
+
+//==============================================================================
+/// Partitions built from fields or blocks are only fetched into read-only
+/// views, so tasks may read or reduce through them but never write.
+//==============================================================================
+void contra_mpi_partition_check_write(contra_mpi_partition_t * part)
+{
+  if (part->indices) {
+    std::cerr << "Tasks can not write to fields through partitions built "
+      << "from fields or blocks." << std::endl;
+    abort();
+  }
+}
+
 //==============================================================================
 /// index space creation
 //==============================================================================
@@ -601,6 +1480,14 @@ contra_mpi_partition_t*  contra_mpi_partition_get(
 void contra_mpi_partition_destroy(contra_mpi_partition_t * part)
 { 
   if (MpiRuntime.decrementPartition(part->id)) {
+    // block partitions own the field holding their indices
+    if (auto idx_fld = MpiRuntime.releaseBlockIndices(part->id)) {
+      auto idx_is = idx_fld->index_space;
+      contra_mpi_field_complete(idx_fld);
+      contra_mpi_field_destroy(idx_fld);
+      delete idx_fld;
+      delete idx_is;
+    }
     part->destroy();
   }
 }
@@ -623,55 +1510,262 @@ void contra_mpi_accessor_setup(
     
     auto res = MpiRuntime.findFieldRequest(fld->data);
     auto & exchange_data = *res.first;
-    auto & requests = exchange_data.getRequests();
-    std::vector<MPI_Status> status(requests.size());
-    auto ret = MPI_Waitall(requests.size(), requests.data(), status.data());
-    MpiRuntime.check(ret);
-    auto recvbuf = static_cast<byte_t*>(exchange_data.getBuffer(1));
-    const auto & recvloc = exchange_data.Locations;
+    if (!exchange_data.isReady(i)) MpiRuntime.wait(exchange_data);
+    auto recvbuf = static_cast<byte_t*>(exchange_data.getBuffer());
 
+    // values arrive in local index order, so no copy is needed
     auto rank_start = part_indices->rank_begin(comm_rank);
     auto start = part_indices->partition->offsets[i];
-    auto end = part_indices->partition->offsets[i+1];
-    auto size = end - start;
     auto offset = start - rank_start;
     
-    acc->setup(size, data_size);
-    auto acc_data = static_cast<byte_t*>(acc->data);
-     
-    for (int_t i=0; i<size; ++i) {
-      auto dest = acc_data + i*data_size;
-      auto src = recvbuf + recvloc[i + offset]*data_size;
-      memcpy(dest, src, data_size); 
-    }
-
-    if (i == part_indices->distribution[comm_rank+1]-1)
-      MpiRuntime.eraseFieldRequest(fld->data);
+    acc->setup( recvbuf + offset*data_size, data_size );
 
   }
   //----------------------------------------------------------------------------
   // Regular partition
   else {
   
+    // points with only local data read the new storage before it arrives
+    byte_t * fld_data = nullptr;
     auto res = MpiRuntime.findFieldRequest(fld->data);
-    if (res.second) {
-      auto & exchange_data = *res.first;
-      auto & requests = exchange_data.getRequests();
-      std::vector<MPI_Status> status(requests.size());
-      auto ret = MPI_Waitall(requests.size(), requests.data(), status.data());
-      MpiRuntime.check(ret);
-      auto buf = exchange_data.transferBuffer();
-      fld->transfer(buf);
-      MpiRuntime.eraseFieldRequest(fld->data);
+    if (res.second && res.first->isReady(i)) {
+      fld_data = static_cast<byte_t*>(res.first->getBuffer());
+    }
+    else {
+      contra_mpi_field_complete(fld);
+      fld_data = static_cast<byte_t*>(fld->data);
     }
-  
-    auto fld_data = static_cast<byte_t*>(fld->data);
 
     auto pos = fld->partition->offsets[i] - fld->rank_begin(comm_rank);
     acc->setup( fld_data + data_size*pos, data_size );
   }
 }
 
+//==============================================================================
+/// Set up an accessor that reduces into a field.
+//==============================================================================
+void contra_mpi_accessor_setup_reduce(
+    int_t i,
+    contra_mpi_partition_t * part,
+    contra_mpi_field_t * fld,
+    contra_mpi_accessor_t * acc,
+    int_t op,
+    int_t is_real,
+    contra_mpi_task_info_t** info)
+{
+  auto data_size = fld->data_size;
+  auto comm_rank = MpiRuntime.getRank();
+  auto size = part->size(i);
+  auto start = part->offsets[i];
+
+  auto red = std::make_unique<contra_mpi_reduction_t>();
+  red->field = fld;
+
+  // remember which entries each value belongs to
+  red->ids.resize(size);
+  if (auto part_indices = part->indices) {
+    auto offset = start - part_indices->rank_begin(comm_rank);
+    auto indices = static_cast<const int_t*>(part_indices->data) + offset;
+    std::copy(indices, indices+size, red->ids.begin());
+  }
+  else {
+    std::iota(red->ids.begin(), red->ids.end(), start);
+  }
+  
+  // contributions start from the identity of the op
+  red->values.resize(size*data_size);
+  reduceInit(red->values.data(), size, op, data_size, is_real);
+  
+  acc->setup( red->values.data(), data_size );
+  (*info)->Reductions.emplace_back( std::move(red) );
+}
+
+//==============================================================================
+/// Ship reduced values to the ranks that own them.
+//==============================================================================
+void contra_mpi_field_reduce(
+    contra_mpi_field_t * fld,
+    int_t op,
+    int_t is_real,
+    contra_mpi_task_info_t** info)
+{
+  auto comm_rank = MpiRuntime.getRank();
+  auto comm_size = MpiRuntime.getSize();
+  auto data_size = fld->data_size;
+  auto & Reductions = (*info)->Reductions;
+
+  // the field storage has to be in place before it is reduced into
+  contra_mpi_field_complete(fld);
+  
+  std::vector<int_t> rank_starts(comm_size);
+  for (decltype(comm_size) r=0; r<comm_size; ++r)
+    rank_starts[r] = fld->rank_begin(r);
+  auto owner = [&](int_t id) {
+    auto it = std::upper_bound(rank_starts.begin(), rank_starts.end(), id);
+    return std::distance(rank_starts.begin(), it) - 1;
+  };
+
+  // ranks without any points may still own entries
+  std::vector<int_t> sendcounts(comm_size, 0);
+  for (const auto & red : Reductions) {
+    if (red->field != fld) continue;
+    for (auto id : red->ids) sendcounts[owner(id)]++;
+  }
+
+  std::vector<int_t> senddispls(comm_size+1);
+  senddispls[0] = 0;
+  for(decltype(comm_size) r = 0; r < comm_size; ++r)
+    senddispls[r + 1] = senddispls[r] + sendcounts[r];
+
+  // pack contributions in owner order
+  std::vector<int_t> send_ids(senddispls[comm_size]);
+  std::vector<byte_t> send_values(senddispls[comm_size]*data_size);
+  std::fill(sendcounts.begin(), sendcounts.end(), 0);
+  
+  for (const auto & red : Reductions) {
+    if (red->field != fld) continue;
+    auto num_ids = red->ids.size();
+    for (size_t j=0; j<num_ids; ++j) {
+      auto id = red->ids[j];
+      auto r = owner(id);
+      auto pos = senddispls[r] + sendcounts[r];
+      send_ids[pos] = id;
+      memcpy(
+          send_values.data() + pos*data_size,
+          red->values.data() + j*data_size,
+          data_size);
+      sendcounts[r]++;
+    }
+  }
+  
+  Reductions.erase(
+      std::remove_if(
+        Reductions.begin(),
+        Reductions.end(),
+        [=](const auto & red) { return red->field == fld; }),
+      Reductions.end());
+
+  auto mpi_int_t = librtmpi::typetraits<int_t>::type();
+  std::vector<int_t> recvcounts(comm_size, 0);
+
+  auto ret = MPI_Alltoall(
+      sendcounts.data(),
+      1,
+      mpi_int_t,
+      recvcounts.data(),
+      1,
+      mpi_int_t,
+      MPI_COMM_WORLD);
+  MpiRuntime.check(ret);
+  
+  std::vector<int_t> recvdispls(comm_size+1);
+  recvdispls[0] = 0;
+  for(decltype(comm_size) r = 0; r < comm_size; ++r)
+    recvdispls[r + 1] = recvdispls[r] + recvcounts[r];
+
+  std::vector<int_t> recv_ids(recvdispls[comm_size]);
+  ret = librtmpi::alltoallv(
+      send_ids,
+      sendcounts,
+      senddispls,
+      recv_ids,
+      recvcounts,
+      recvdispls,
+      MPI_COMM_WORLD);
+  MpiRuntime.check(ret);
+
+  for (auto & c : sendcounts) c *= data_size;
+  for (auto & d : senddispls) d *= data_size;
+  for (auto & c : recvcounts) c *= data_size;
+  for (auto & d : recvdispls) d *= data_size;
+  
+  std::vector<byte_t> recv_values(recvdispls[comm_size]);
+  ret = librtmpi::alltoallv(
+      send_values,
+      sendcounts,
+      senddispls,
+      recv_values,
+      recvcounts,
+      recvdispls,
+      MPI_COMM_WORLD);
+  MpiRuntime.check(ret);
+
+  // fold everything that arrived into local storage
+  auto fld_data = static_cast<byte_t*>(fld->data);
+  auto local_start = fld->rank_begin(comm_rank);
+  auto num_recv = recv_ids.size();
+  for (size_t j=0; j<num_recv; ++j) {
+    auto pos = recv_ids[j] - local_start;
+    reduceApply(
+        fld_data + pos*data_size,
+        recv_values.data() + j*data_size,
+        1,
+        op,
+        data_size,
+        is_real);
+  }
+}
+
+//==============================================================================
+/// Reset the arrays all but one rank reduce into.
+//==============================================================================
+void contra_mpi_array_reduction_setup(
+    dopevector_t * arr,
+    int_t op,
+    int_t is_real)
+{
+  if (MpiRuntime.getRank() == 0) return;
+  reduceInit(arr->data, arr->size, op, arr->data_size, is_real);
+}
+
+//==============================================================================
+/// Combine every rank's copy of an array.
+//==============================================================================
+void contra_mpi_array_reduce(
+    dopevector_t * arr,
+    int_t op,
+    int_t is_real)
+{
+  MPI_Datatype mpi_t;
+  if (is_real && arr->data_size == sizeof(float))
+    mpi_t = librtmpi::typetraits<float>::type();
+  else if (is_real)
+    mpi_t = librtmpi::typetraits<real_t>::type();
+  else if (arr->data_size == sizeof(int32_t))
+    mpi_t = librtmpi::typetraits<int32_t>::type();
+  else
+    mpi_t = librtmpi::typetraits<int_t>::type();
+
+  MPI_Op mpi_op;
+  switch (static_cast<ReductionType>(op)) {
+    case ReductionType::Add:
+      mpi_op = MPI_SUM;
+      break;
+    case ReductionType::Mult:
+      mpi_op = MPI_PROD;
+      break;
+    case ReductionType::Min:
+      mpi_op = MPI_MIN;
+      break;
+    case ReductionType::Max:
+      mpi_op = MPI_MAX;
+      break;
+    default:
+      std::cerr << "Unsupported array reduction op." << std::endl;
+      abort();
+  }
+
+  // the array is contiguous, so one collective covers every entry
+  auto ret = MPI_Allreduce(
+      MPI_IN_PLACE,
+      arr->data,
+      arr->size,
+      mpi_t,
+      mpi_op,
+      MPI_COMM_WORLD);
+  MpiRuntime.check(ret);
+}
+
 //==============================================================================
 /// Accessor write
 //==============================================================================
@@ -709,33 +1803,79 @@ void contra_mpi_accessor_destroy(
 void contra_mpi_reduce(
     MPI_User_function *fun,
     void * sendbuf,
-    void * recvbuf,
-    size_t count)
+    size_t count,
+    contra_mpi_future_t * fut)
 {
-#if 1
-  MPI_Op op;
-  auto ret = MPI_Op_create(fun, true, &op);
-  MpiRuntime.check(ret);
+  // the send buffer is copied so the caller may reuse it right away
+  auto exchange = new reduce_exchange_t(sendbuf, count);
+  fut->exchange = exchange;
+  exchange->PostTime = MPI_Wtime();
 
+  auto ret = MPI_Op_create(fun, true, &exchange->Op);
+  MpiRuntime.check(ret);
 
-  ret = MPI_Allreduce(
-      sendbuf,
-      recvbuf,
-      count,
-      MPI_BYTE,
-      op,
-      MPI_COMM_WORLD);
+  // reduce the whole result struct as a single element so the user function
+  // is never handed a partial struct
+  ret = MPI_Type_contiguous(count, MPI_BYTE, &exchange->Type);
   MpiRuntime.check(ret);
-#else
-  auto ret = MPI_Allreduce(
-      sendbuf,
-      recvbuf,
+  ret = MPI_Type_commit(&exchange->Type);
+  MpiRuntime.check(ret);
+
+  ret = MPI_Iallreduce(
+      exchange->SendBuf.data(),
+      exchange->RecvBuf.data(),
       1,
-      MPI_DOUBLE,
-      MPI_MAX,
-      MPI_COMM_WORLD);
+      exchange->Type,
+      exchange->Op,
+      MPI_COMM_WORLD,
+      &exchange->Request);
   MpiRuntime.check(ret);
-#endif
+}
+
+//==============================================================================
+/// Wait on a reduction and fetch its result
+//==============================================================================
+void contra_mpi_future_wait(
+    contra_mpi_future_t * fut,
+    void * result)
+{
+  auto exchange = fut->exchange;
+
+  if (exchange->isPending()) {
+    auto start = MPI_Wtime();
+    auto ret = MPI_Wait(&exchange->Request, MPI_STATUS_IGNORE);
+    MpiRuntime.check(ret);
+    auto stop = MPI_Wtime();
+    MpiRuntime.recordReduction(stop - exchange->PostTime, stop - start);
+    ret = MPI_Op_free(&exchange->Op);
+    MpiRuntime.check(ret);
+    ret = MPI_Type_free(&exchange->Type);
+    MpiRuntime.check(ret);
+  }
+
+  memcpy(result, exchange->RecvBuf.data(), exchange->RecvBuf.size());
+}
+
+//==============================================================================
+/// Destroy a reduction future
+//==============================================================================
+void contra_mpi_future_destroy(contra_mpi_future_t * fut)
+{
+  auto exchange = fut->exchange;
+  if (!exchange) return;
+
+  if (exchange->isPending()) {
+    auto start = MPI_Wtime();
+    auto ret = MPI_Wait(&exchange->Request, MPI_STATUS_IGNORE);
+    MpiRuntime.check(ret);
+    auto stop = MPI_Wtime();
+    MpiRuntime.recordReduction(stop - exchange->PostTime, stop - start);
+    MPI_Op_free(&exchange->Op);
+    MPI_Type_free(&exchange->Type);
+  }
+
+  delete exchange;
+  fut->exchange = nullptr;
 }
 
 } // extern
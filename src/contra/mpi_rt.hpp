@@ -10,16 +10,37 @@
 
 #include <cstring>
 #include <iostream>
+#include <algorithm>
 #include <map>
+#include <memory>
+#include <string>
+#include <tuple>
 #include <vector>
 
+struct contra_mpi_field_t;
+
 namespace contra {
 
+////////////////////////////////////////////////////////////////////////////////
+/// communication statistics
+////////////////////////////////////////////////////////////////////////////////
+struct exchange_stats_t {
+  double BytesSent = 0;
+  double BytesRecvd = 0;
+  double MessagesSent = 0;
+  double MessagesRecvd = 0;
+  double WaitTime = 0;
+
+  void pack(std::vector<double> & vals) const
+  { vals.insert(vals.end(), {BytesSent, BytesRecvd, MessagesSent, MessagesRecvd, WaitTime}); }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 /// field registry data
 ////////////////////////////////////////////////////////////////////////////////
 struct field_registry_t {
   std::shared_ptr<void> Init;
+  exchange_stats_t * Stats = nullptr;
 
   field_registry_t(int_t data_size, const void * init)
   {
@@ -39,35 +60,116 @@ struct field_registry_t {
 struct field_exchange_t {
   std::vector<void*> RecvBufs;
   std::vector<MPI_Request> Requests;
-  std::vector<int_t> Locations;
   
+  // index points whose data is already local
+  int_t ReadyStart = 0;
+  std::vector<bool> Ready;
 
-  void setup(int_t recvsize, int_t reqsize)
-  {
-    RecvBufs.emplace_back( malloc(recvsize) );
-    Requests.reserve(reqsize);
-  }
+  // received data replaces the field storage
+  bool ReplacesData = false;
+
+  // window exposing the field for one-sided fetches
+  MPI_Win Win = MPI_WIN_NULL;
+
+  // where time spent waiting is accounted
+  exchange_stats_t * FieldStats = nullptr;
+  exchange_stats_t * LaunchStats = nullptr;
   
-  void setup(int_t recvsize, int_t sendsize, int_t reqsize)
-  {
-    RecvBufs.emplace_back( malloc(recvsize) );
-    RecvBufs.emplace_back( malloc(sendsize) );
-    Requests.reserve(reqsize);
-  }
 
+  void setup(int_t recvsize, int_t reqsize, bool shared);
+  
   auto getBuffer(int i=0) const { return RecvBufs[i]; }
   auto & getRequests() { return Requests; }
 
+  void setReady(int_t start, int_t size)
+  {
+    ReadyStart = start;
+    Ready.assign(size, false);
+  }
+
+  bool isReady(int_t i) const {
+    auto j = i - ReadyStart;
+    return j>=0 && j<static_cast<int_t>(Ready.size()) && Ready[j];
+  }
+
   auto transferBuffer(int i=0) {
     auto buf = RecvBufs[i];
     RecvBufs[i] = nullptr;
     return buf;
   }
 
-  ~field_exchange_t() {
-    for (auto RecvBuf : RecvBufs)
-      if (RecvBuf) free(RecvBuf);
+  ~field_exchange_t();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// field storage shared by the ranks of a node
+////////////////////////////////////////////////////////////////////////////////
+struct shared_segment_t {
+  unsigned Id = 0;
+  MPI_Win Win = MPI_WIN_NULL;
+  std::vector<byte_t*> Bases;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// exchange plan for fetching a field through an indexed partition
+////////////////////////////////////////////////////////////////////////////////
+struct indexed_plan_t {
+  std::vector<int_t> Dist;
+  std::vector<int_t> FieldDist;
+  std::vector<int> SendRanks;
+  std::vector<int> RecvRanks;
+  std::vector<MPI_Datatype> SendTypes;
+  std::vector<MPI_Datatype> RecvTypes;
+  std::vector<MPI_Datatype> TargetTypes;
+  std::vector<int> CopyRanks;
+  std::vector<int_t> CopyFrom;
+  std::vector<int_t> CopyTo;
+  std::vector<bool> Ready;
+  int_t NumIndices = 0;
+
+  bool matches(const int_t * dist, const int_t * field_dist, int_t size) const
+  {
+    auto n = static_cast<size_t>(size+1);
+    return Dist.size() == n && FieldDist.size() == n &&
+      std::equal(Dist.begin(), Dist.end(), dist) &&
+      std::equal(FieldDist.begin(), FieldDist.end(), field_dist);
   }
+
+  indexed_plan_t() = default;
+  ~indexed_plan_t() { destroy(); }
+
+  // the mpi types are freed on destruction, so they can not be shared
+  indexed_plan_t(const indexed_plan_t&) = delete;
+  indexed_plan_t& operator=(const indexed_plan_t&) = delete;
+
+  void destroy();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// measured costs of a repeated launch
+////////////////////////////////////////////////////////////////////////////////
+struct load_balance_t {
+  std::vector<int_t> Dist;
+  std::vector<double> Costs;
+  unsigned Launches = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+/// reduction exchange data
+////////////////////////////////////////////////////////////////////////////////
+struct reduce_exchange_t {
+  std::vector<byte_t> SendBuf;
+  std::vector<byte_t> RecvBuf;
+  MPI_Request Request = MPI_REQUEST_NULL;
+  MPI_Op Op = MPI_OP_NULL;
+  MPI_Datatype Type = MPI_DATATYPE_NULL;
+  double PostTime = 0;
+
+  reduce_exchange_t(const void * sendbuf, size_t size) :
+    SendBuf(size), RecvBuf(size)
+  { memcpy(SendBuf.data(), sendbuf, size); }
+
+  bool isPending() const { return Request != MPI_REQUEST_NULL; }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -80,12 +182,40 @@ class mpi_runtime_t {
   unsigned TaskCounter = 0;
   unsigned FieldCounter = 0;
   unsigned PartitionCounter = 0;
+
+  bool UseRma = false;
+  bool UseShm = false;
+
+  MPI_Comm NodeComm = MPI_COMM_NULL;
+  std::vector<int> NodeRanks;
+  unsigned SegmentCounter = 0;
+  std::map<void*, shared_segment_t> SharedSegments;
+  std::map<unsigned, MPI_Win> ReleasedSegments;
+
+  unsigned BalanceFrequency = 0;
+  double BalanceThreshold = 1.1;
+
+  using LoadBalanceKey = std::pair<std::string, int_t>;
+  std::map<LoadBalanceKey, load_balance_t> LoadBalance;
+
+  bool UseStats = false;
+  std::string StatsFile;
+  std::map<std::string, exchange_stats_t> FieldStats;
+  std::map<std::string, exchange_stats_t> LaunchStats;
+  double NumReductions = 0;
+  double ReduceLatency = 0;
+  double ReduceWait = 0;
   
   std::map<unsigned, field_registry_t> FieldRegistry;
   std::map<void*, field_exchange_t> FieldRequests;
 
   std::map<unsigned, unsigned> PartitionRegistry;
 
+  using IndexedPlanKey = std::tuple<unsigned, unsigned, int_t>;
+  std::map<IndexedPlanKey, indexed_plan_t> IndexedPlans;
+
+  std::map<unsigned, contra_mpi_field_t*> BlockIndices;
+
 
 public:
   
@@ -95,37 +225,70 @@ public:
     Size = size;
   }
 
+  void configure(int argc, const char ** argv);
+
+  bool useRma() const { return UseRma; }
+  bool useShm() const { return UseShm; }
+
+  void setupNode();
+  void syncNode();
+
+  bool isOnNode(int rank) const
+  { return UseShm && rank != Rank && NodeRanks[rank] >= 0; }
+
+  void * allocate(size_t);
+  void deallocate(void *);
+  void releaseSegments();
+
+  byte_t * getNodePointer(void * data, int rank)
+  { return SharedSegments.at(data).Bases[ NodeRanks[rank] ]; }
+
+  bool useBalance() const { return BalanceFrequency > 0; }
+
+  auto & getLoadBalance(const char * name, int_t size)
+  { return LoadBalance[ LoadBalanceKey{name, size} ]; }
+
+  void rebalance(load_balance_t &);
+
+  bool useStats() const { return UseStats; }
+
+  auto & getLaunchStats(const char * name) { return LaunchStats[name]; }
+
+  void recordReduction(double latency, double wait)
+  {
+    NumReductions++;
+    ReduceLatency += latency;
+    ReduceWait += wait;
+  }
+
+  void report();
+
   void incrementTaskCounter() { TaskCounter++; }
   void decrementTaskCounter() { TaskCounter--; }
   auto getTaskCounter() { return TaskCounter; }
 
   void check(int);
+  void wait(field_exchange_t &);
   bool isRoot() const { return Rank == 0; }
 
   auto getSize() const { return Size; }
   auto getRank() const { return Rank; }
 
-  auto registerField(int_t data_size, const void * init)
+  auto registerField(const char * name, int_t data_size, const void * init)
   {
     auto fid = FieldCounter++;
-    FieldRegistry.emplace(fid, field_registry_t{data_size, init});
+    auto it = FieldRegistry.emplace(fid, field_registry_t{data_size, init});
+    if (UseStats) it.first->second.Stats = &FieldStats[name];
     return fid;
   }
   void deregisterField(unsigned i) { FieldRegistry.erase(i); }
 
   auto & getRegisteredField(unsigned i) { return FieldRegistry.at(i); }
 
-  auto & requestField(void * key, int_t recvcnt, int_t reqcnt) 
-  { 
-    auto & obj = FieldRequests[key];
-    obj.setup(recvcnt, reqcnt);
-    return obj;
-  }
-  
-  auto & requestField(void * key, int_t recvcnt, int_t sendcnt, int_t reqcnt) 
+  auto & requestField(void * key, int_t recvcnt, int_t reqcnt, bool shared=false) 
   { 
     auto & obj = FieldRequests[key];
-    obj.setup(recvcnt, sendcnt, reqcnt);
+    obj.setup(recvcnt, reqcnt, shared);
     return obj;
   }
 
@@ -144,6 +307,21 @@ public:
   void eraseFieldRequest(void *data)
   { FieldRequests.erase(data); }
 
+  auto & getIndexedPlan(unsigned part_id, unsigned field_part_id, int_t data_size)
+  { return IndexedPlans[ IndexedPlanKey{part_id, field_part_id, data_size} ]; }
+
+  void eraseIndexedPlans(unsigned id)
+  {
+    auto it = IndexedPlans.begin();
+    while (it != IndexedPlans.end()) {
+      const auto & key = it->first;
+      if (std::get<0>(key) == id || std::get<1>(key) == id)
+        it = IndexedPlans.erase(it);
+      else
+        ++it;
+    }
+  }
+
   auto registerPartition() {
     auto pid = PartitionCounter++;
     PartitionRegistry.emplace(pid, 1);
@@ -154,6 +332,7 @@ public:
     auto & Part = PartitionRegistry.at(id);
     if (Part <= 1) {
       PartitionRegistry.erase(id);
+      eraseIndexedPlans(id);
       return true;
     }
     else {
@@ -167,6 +346,18 @@ public:
     PartitionRegistry[id]++;
   }
 
+  void registerBlockIndices(unsigned id, contra_mpi_field_t * fld)
+  { BlockIndices.emplace(id, fld); }
+
+  contra_mpi_field_t * releaseBlockIndices(unsigned id)
+  {
+    auto it = BlockIndices.find(id);
+    if (it == BlockIndices.end()) return nullptr;
+    auto fld = it->second;
+    BlockIndices.erase(it);
+    return fld;
+  }
+
 };
 
 } // namespace
@@ -261,28 +452,9 @@ struct contra_mpi_field_t {
     partition = nullptr;
   }
 
-  void destroy() {
-    if (data) free(data);
-    data_size = 0;
-    data = nullptr;
-    index_space = nullptr;
-    id = -1;
-    if (distribution) delete[] distribution;
-    if (partition) delete partition;
-  }
+  void destroy();
 
-  int_t allocate(contra_mpi_partition_t *part, int_t *dist, int_t rank, int_t size)
-  {
-    distribution = new int_t[size+1];
-    memcpy(distribution, dist, (size+1)*sizeof(int_t));
-
-    partition = new contra_mpi_partition_t;
-    *partition = *part;
-    
-    auto len = part->offsets[dist[rank+1]] - part->offsets[dist[rank]];
-    data = malloc(data_size*len);
-    return len;
-  }
+  int_t allocate(contra_mpi_partition_t *part, int_t *dist, int_t rank, int_t size);
 
   void redistribute(contra_mpi_partition_t *part, int_t *dist, int_t size)
   {
@@ -290,10 +462,7 @@ struct contra_mpi_field_t {
     memcpy(distribution, dist, (size+1)*sizeof(int_t));
   }
 
-  void transfer(void * buf) {
-    if (data) free(data);
-    data = buf;
-  }
+  void transfer(void * buf);
   
   int_t rank_begin(int_t i) { return partition->offsets[distribution[i]]; }
   int_t rank_end(int_t i) { return partition->offsets[distribution[i+1]]; }
@@ -331,16 +500,41 @@ struct contra_mpi_accessor_t {
 
 void contra_mpi_partition_destroy(contra_mpi_partition_t * part);
 
+//==============================================================================
+struct contra_mpi_future_t {
+  contra::reduce_exchange_t * exchange;
+};
+
+//==============================================================================
+/// Contributions index points reduce into a field
+//==============================================================================
+struct contra_mpi_reduction_t {
+  contra_mpi_field_t * field;
+  std::vector<int_t> ids;
+  std::vector<byte_t> values;
+};
+
 //==============================================================================
 struct contra_mpi_task_info_t {
   std::map<contra_index_space_t*, contra_mpi_partition_t*> IndexPartMap;
   std::vector<contra_mpi_partition_t*> PartsToDelete;
+  std::vector<contra_mpi_field_t*> FieldsFetched;
+  std::vector<std::unique_ptr<contra_mpi_reduction_t>> Reductions;
+  std::vector<int_t> Schedule;
+  int_t ScheduleStart = 0;
+  int_t ScheduleStep = 1;
+  contra::load_balance_t * Balance = nullptr;
+  contra::exchange_stats_t * Stats = nullptr;
+  double PointStart = 0;
 
   void register_partition(
       contra_index_space_t * is,
       contra_mpi_partition_t * part)
   { IndexPartMap.emplace(is, part); }
 
+  void register_field(contra_mpi_field_t * fld)
+  { FieldsFetched.emplace_back(fld); }
+
   std::pair<contra_mpi_partition_t*, bool>
     getOrCreatePartition(contra_index_space_t * is)
   {
@@ -366,13 +560,18 @@ struct contra_mpi_task_info_t {
 // Function prototypes for mpi runtime
 ////////////////////////////////////////////////////////////////////////////////
 
+/// finish any outstanding field exchange
+void contra_mpi_field_complete(contra_mpi_field_t * fld);
+
 /// index space creation
 void contra_mpi_partition_from_size(
     int_t size,
     contra_index_space_t * is,
     contra_mpi_partition_t * part);
-//void contra_mpi_init(int * argc, char *** argv);
-//void contra_mpi_finalize();
+/// startup runtime
+void contra_mpi_init(int argc, const char ** argv);
+/// shutdown runtime
+void contra_mpi_finalize();
 
 } // extern
 
@@ -0,0 +1,120 @@
+#ifndef CONTRA_REDUCE_RT_HPP
+#define CONTRA_REDUCE_RT_HPP
+
+#include "config.hpp"
+#include "reductions.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Element-wise reductions into fields and arrays.
+///
+/// Ops arrive as the integer value of a ReductionType, and elements are
+/// either integers or reals of the given size.
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+template<typename T>
+void reduceInit(T * data, int_t size, ReductionType op)
+{
+  T init;
+  switch (op) {
+    case ReductionType::Add:
+      init = 0;
+      break;
+    case ReductionType::Mult:
+      init = 1;
+      break;
+    case ReductionType::Min:
+      init = std::numeric_limits<T>::max();
+      break;
+    case ReductionType::Max:
+      init = std::numeric_limits<T>::lowest();
+      break;
+    default:
+      std::cerr << "Unsupported field reduction op." << std::endl;
+      abort();
+  }
+  std::fill(data, data+size, init);
+}
+
+//==============================================================================
+// The op is picked outside the loops so each one can be vectorized
+//==============================================================================
+template<typename T>
+void reduceApply(T * lhs, const T * rhs, int_t size, ReductionType op)
+{
+  switch (op) {
+    case ReductionType::Add:
+      for (int_t i=0; i<size; ++i) lhs[i] += rhs[i];
+      break;
+    case ReductionType::Mult:
+      for (int_t i=0; i<size; ++i) lhs[i] *= rhs[i];
+      break;
+    case ReductionType::Min:
+      for (int_t i=0; i<size; ++i) lhs[i] = std::min(lhs[i], rhs[i]);
+      break;
+    case ReductionType::Max:
+      for (int_t i=0; i<size; ++i) lhs[i] = std::max(lhs[i], rhs[i]);
+      break;
+    default:
+      std::cerr << "Unsupported field reduction op." << std::endl;
+      abort();
+  }
+}
+
+//==============================================================================
+/// Fill a buffer with the identity of the op
+//==============================================================================
+inline void reduceInit(
+    void * data,
+    int_t size,
+    int_t op,
+    int_t data_size,
+    bool is_real)
+{
+  auto rop = static_cast<ReductionType>(op);
+  if (is_real && data_size == sizeof(float))
+    reduceInit(static_cast<float*>(data), size, rop);
+  else if (is_real)
+    reduceInit(static_cast<real_t*>(data), size, rop);
+  else if (data_size == sizeof(int32_t))
+    reduceInit(static_cast<int32_t*>(data), size, rop);
+  else
+    reduceInit(static_cast<int_t*>(data), size, rop);
+}
+
+//==============================================================================
+/// Combine a run of elements into another
+//==============================================================================
+inline void reduceApply(
+    void * lhs,
+    const void * rhs,
+    int_t size,
+    int_t op,
+    int_t data_size,
+    bool is_real)
+{
+  auto rop = static_cast<ReductionType>(op);
+  if (is_real && data_size == sizeof(float))
+    reduceApply(
+        static_cast<float*>(lhs), static_cast<const float*>(rhs), size, rop);
+  else if (is_real)
+    reduceApply(
+        static_cast<real_t*>(lhs), static_cast<const real_t*>(rhs), size, rop);
+  else if (data_size == sizeof(int32_t))
+    reduceApply(
+        static_cast<int32_t*>(lhs), static_cast<const int32_t*>(rhs), size, rop);
+  else
+    reduceApply(
+        static_cast<int_t*>(lhs), static_cast<const int_t*>(rhs), size, rop);
+}
+
+} // namespace
+
+#endif // CONTRA_REDUCE_RT_HPP
@@ -48,9 +48,9 @@ StructType * SerialTasker::createFieldType()
 StructType * SerialTasker::createAccessorType()
 {
   std::vector<Type*> members = {
-    BoolType_,
     IntType_,
-    VoidPtrType_};
+    VoidPtrType_,
+    IntType_->getPointerTo()};
   auto NewType = StructType::create( TheContext_, members, "contra_serial_accessor_t" );
   return NewType;
 }
@@ -261,6 +261,13 @@ Value* SerialTasker::launch(
           IndexPartitionType_->getPointerTo(),
           {IndexSpaceA, FieldA, PartInfoA});
     }
+    if (!TaskI.getArgReduction(i) && isWrite(TaskI.getArgAccess(i))) {
+      TheHelper_.callFunction(
+          TheModule,
+          "contra_serial_partition_check_write",
+          VoidType_,
+          {IndexPartitionA});
+    }
     auto AccessorA = TheHelper_.createEntryBlockAlloca(AccessorType_);
     AccessorData.emplace( i, std::make_pair(AccessorA, IndexPartitionA) );
   }
@@ -519,6 +526,32 @@ AllocaInst* SerialTasker::createPartition(
   return IndexPartA;
 }
 
+//==============================================================================
+// create a block partition
+//==============================================================================
+AllocaInst* SerialTasker::createBlockPartition(
+    Module & TheModule,
+    Value* IndexSpaceA,
+    Value* DimsA,
+    Value* BlocksA)
+{
+  auto IndexPartA = TheHelper_.createEntryBlockAlloca(IndexPartitionType_);
+
+  std::vector<Value*> FunArgVs = {
+    TheHelper_.getAsAlloca(DimsA),
+    TheHelper_.getAsAlloca(BlocksA),
+    TheHelper_.getAsAlloca(IndexSpaceA),
+    IndexPartA};
+  
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_serial_partition_from_blocks",
+      VoidType_,
+      FunArgVs);
+
+  return IndexPartA;
+}
+
 //==============================================================================
 // Is this a field type
 //==============================================================================
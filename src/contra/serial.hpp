@@ -82,6 +82,8 @@ public:
       const std::vector<llvm::Type*> &,
       const std::vector<ReductionType> &) override;
 
+  virtual bool hasArrayReductions() const override { return true; }
+
   
   virtual llvm::AllocaInst* createPartition(
       llvm::Module &,
@@ -92,6 +94,11 @@ public:
       llvm::Module &,
       llvm::Value*,
       llvm::Value*) override;
+  virtual llvm::AllocaInst* createBlockPartition(
+      llvm::Module &,
+      llvm::Value*,
+      llvm::Value*,
+      llvm::Value*) override;
   
   virtual llvm::Type* getPartitionType(llvm::Type*) const override
   { return IndexPartitionType_; }
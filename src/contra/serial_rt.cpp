@@ -1,5 +1,7 @@
+#include "blocks_rt.hpp"
 #include "serial_rt.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
@@ -142,6 +144,44 @@ void contra_serial_partition_from_array(
   //------------------------------------
 }
 
+//==============================================================================
+/// block partition of a row-major index space
+//==============================================================================
+void contra_serial_partition_from_blocks(
+    dopevector_t * dims_arr,
+    dopevector_t * blocks_arr,
+    contra_index_space_t * is,
+    contra_serial_partition_t * part)
+{
+  int_t num_parts;
+  int_t * indices;
+  int_t * offsets;
+  contra::blockPartition(
+      static_cast<const int_t*>(dims_arr->data),
+      dims_arr->size,
+      static_cast<const int_t*>(blocks_arr->data),
+      blocks_arr->size,
+      is->size(),
+      num_parts,
+      indices,
+      offsets);
+
+  part->setup(is->size(), num_parts, is, indices, offsets);
+}
+
+//==============================================================================
+/// Partitions built from fields or blocks may overlap, so tasks may read or
+/// reduce through them but never write.
+//==============================================================================
+void contra_serial_partition_check_write(contra_serial_partition_t * part)
+{
+  if (part->indices) {
+    std::cerr << "Tasks can not write to fields through partitions built "
+      << "from fields or blocks." << std::endl;
+    abort();
+  }
+}
+
 //==============================================================================
 /// index space creation
 //==============================================================================
@@ -230,15 +270,8 @@ void contra_serial_accessor_setup(
   auto data_size = fld->data_size;
 
   if (part->indices) {
-    auto size = part->size(i);
-    acc->setup( size, data_size );
-    auto dest = static_cast<byte_t*>(acc->data);
     auto off = part->offsets[i];
-    for (int_t j=0; j<size; ++j) {
-      const auto src = fld_data + data_size*part->indices[off + j];
-      memcpy(dest, src, data_size);
-      dest += data_size;
-    }
+    acc->setup( fld_data, data_size, part->indices + off );
   }
   else {
     auto offsets = part->offsets;
@@ -254,8 +287,7 @@ void contra_serial_accessor_write(
     const void * data,
     int_t index)
 {
-  byte_t * offset = static_cast<byte_t*>(acc->data) + acc->data_size*index;
-  memcpy(offset, data, acc->data_size);
+  memcpy(acc->at(index), data, acc->data_size);
 }
 
 //==============================================================================
@@ -266,8 +298,7 @@ void contra_serial_accessor_read(
     void * data,
     int_t index)
 {
-  const byte_t * offset = static_cast<const byte_t*>(acc->data) + acc->data_size*index;
-  memcpy(data, offset, acc->data_size);
+  memcpy(data, acc->at(index), acc->data_size);
 }
 
 //==============================================================================
@@ -104,27 +104,26 @@ struct contra_serial_field_t {
 
 //==============================================================================
 struct contra_serial_accessor_t {
-  bool is_allocated;
   int_t data_size;
   void *data;
+  const int_t *indices;
   
-  void setup(void * ptr, int_t data_sz) {
-    is_allocated = false;
+  void setup(void * ptr, int_t data_sz, const int_t * indx = nullptr) {
     data_size = data_sz;
     data = ptr;
+    indices = indx;
   }
 
-  void setup(int_t size, int_t data_sz) {
-    is_allocated = true;
-    data_size = data_sz;  
-    data = malloc(size * data_size);
+  /// indexed partitions read and write the field in place
+  byte_t * at(int_t index) {
+    if (indices) index = indices[index];
+    return static_cast<byte_t*>(data) + data_size*index;
   }
   
   void destroy() {
-    if (is_allocated) free(data);
-    is_allocated = false;
     data_size = 0;
     data = nullptr;
+    indices = nullptr;
   }
 };
 
@@ -170,6 +169,13 @@ void contra_serial_partition_from_size(
     contra_index_space_t * is,
     contra_serial_partition_t * part);
 
+/// block partition of a row-major index space
+void contra_serial_partition_from_blocks(
+    dopevector_t * dims,
+    dopevector_t * blocks,
+    contra_index_space_t * is,
+    contra_serial_partition_t * part);
+
 
 } // extern
 
@@ -331,7 +331,8 @@ public:
   
   enum Attr : unsigned {
     None  = (1u << 0),
-    Task  = (1u << 1)
+    Task  = (1u << 1),
+    Inline = (1u << 2)
   };
 
 protected:
@@ -357,7 +358,7 @@ public:
       Attrs_(Attr::None)
   {}
 
-  //virtual ~FunctionTypeDef() = default;
+  virtual ~FunctionDef() = default;
 
   const auto & getName() const { return Name_; }
   const auto & getReturnType() const { return ReturnType_; }
@@ -373,6 +374,12 @@ public:
     if (IsTask) Attrs_ |= Attr::Task;
     else Attrs_ &= ~Attr::Task;
   }
+  
+  bool isInline() const { return ((Attrs_ & Attr::Inline) == Attr::Inline); }
+  void setInline(bool IsInline=true) {
+    if (IsInline) Attrs_ |= Attr::Inline;
+    else Attrs_ &= ~Attr::Inline;
+  }
 };
 
 
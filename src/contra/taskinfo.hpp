@@ -1,14 +1,27 @@
 #ifndef CONTRA_TASKINFO_HPP
 #define CONTRA_TASKINFO_HPP
 
+#include "accessinfo.hpp"
 #include "reduceinfo.hpp"
+#include "reductions.hpp"
 
 #include "llvm/IR/IRBuilder.h"
 
+#include <map>
 #include <string>
+#include <vector>
 
 namespace contra {
 
+//==============================================================================
+// How a task reduces into one of its field or array arguments
+//==============================================================================
+struct ArgReduction {
+  ReductionType Op;
+  llvm::Type* DataType;
+  std::unique_ptr<AbstractReduceInfo> Redop;
+};
+
 //==============================================================================
 // Task info
 //==============================================================================
@@ -20,6 +33,9 @@ class TaskInfo {
   bool IsTop_ = false;
   bool IsLeaf_ = false;
 
+  std::vector<FieldAccess> ArgAccesses_;
+  std::map<unsigned, ArgReduction> ArgReductions_;
+
   std::unique_ptr<AbstractReduceInfo> Redop_;
 
 public:
@@ -50,6 +66,24 @@ public:
   bool isLeaf() const { return IsLeaf_; }
   void setLeaf(bool IsLeaf = true) { IsLeaf_ = IsLeaf; }
 
+  void setArgAccesses(const std::vector<FieldAccess> & Accesses)
+  { ArgAccesses_ = Accesses; }
+  FieldAccess getArgAccess(unsigned i) const
+  { return i < ArgAccesses_.size() ? ArgAccesses_[i] : FieldAccess::ReadWrite; }
+
+  void setArgReduction(
+      unsigned i,
+      ReductionType Op,
+      llvm::Type* DataT,
+      std::unique_ptr<AbstractReduceInfo> Redop)
+  { ArgReductions_[i] = ArgReduction{Op, DataT, std::move(Redop)}; }
+  const ArgReduction* getArgReduction(unsigned i) const
+  {
+    auto it = ArgReductions_.find(i);
+    return it != ArgReductions_.end() ? &it->second : nullptr;
+  }
+  const auto & getArgReductions() const { return ArgReductions_; }
+
   bool hasReduction() const { return static_cast<bool>(Redop_); }
   auto getReduction() const { return Redop_.get(); }
   void setReduction(std::unique_ptr<AbstractReduceInfo> Redop)
@@ -206,6 +206,18 @@ llvm::Value* AbstractTasker::loadRangeValue(
   return Builder_.CreateAdd(StartV, IndexV);
 }
 
+//==============================================================================
+// Partition a row-major index space into blocks
+//==============================================================================
+AllocaInst* AbstractTasker::createBlockPartition(
+    Module &,
+    Value*,
+    Value*,
+    Value*)
+{
+  THROW_CONTRA_ERROR("Block partitions are not supported by this backend.");
+}
+
 //==============================================================================
 Type* AbstractTasker::reduceStruct(
     StructType * StructT,
@@ -435,24 +447,20 @@ Value* AbstractTasker::deserialize(
 Constant* AbstractTasker::initReduce(Type* VarT, ReductionType Op)
 {
   Constant* InitC = nullptr;
-    
-  constexpr auto MinReal = std::numeric_limits<real_t>::lowest();
-  constexpr auto MaxReal = std::numeric_limits<real_t>::max();
-  constexpr auto MinInt  = std::numeric_limits<int_t>::lowest();
-  constexpr auto MaxInt  = std::numeric_limits<int_t>::max();
 
   // Floating point
   if (VarT->isFloatingPointTy()) {
+    const auto & Sem = VarT->getFltSemantics();
     if (Op == ReductionType::Add ||
         Op == ReductionType::Sub)
-      InitC = llvmValue<real_t>(TheContext_, 0);
+      InitC = ConstantFP::get(VarT, 0.0);
     else if (Op == ReductionType::Mult ||
              Op == ReductionType::Div)
-      InitC = llvmValue<real_t>(TheContext_, 1);
+      InitC = ConstantFP::get(VarT, 1.0);
     else if (Op == ReductionType::Min)
-      InitC = llvmValue<real_t>(TheContext_, MaxReal);
+      InitC = ConstantFP::get(TheContext_, APFloat::getLargest(Sem));
     else if (Op == ReductionType::Max)
-      InitC = llvmValue<real_t>(TheContext_, MinReal);
+      InitC = ConstantFP::get(TheContext_, APFloat::getLargest(Sem, true));
     else {
       std::cerr << "Unsupported reduction op." << std::endl;;
       abort();
@@ -460,16 +468,17 @@ Constant* AbstractTasker::initReduce(Type* VarT, ReductionType Op)
   }
   // Integer
   else {
+    auto Bits = VarT->getIntegerBitWidth();
     if (Op == ReductionType::Add ||
         Op == ReductionType::Sub)
-      InitC = llvmValue<int_t>(TheContext_, 0);
+      InitC = ConstantInt::get(VarT, 0);
     else if (Op == ReductionType::Mult ||
              Op == ReductionType::Div)
-      InitC = llvmValue<int_t>(TheContext_, 1);
+      InitC = ConstantInt::get(VarT, 1);
     else if (Op == ReductionType::Min)
-      InitC = llvmValue<int_t>(TheContext_, MaxInt);
+      InitC = ConstantInt::get(TheContext_, APInt::getSignedMaxValue(Bits));
     else if (Op == ReductionType::Max)
-      InitC = llvmValue<int_t>(TheContext_, MinInt);
+      InitC = ConstantInt::get(TheContext_, APInt::getSignedMinValue(Bits));
     else {
       std::cerr << "Unsupported reduction op." << std::endl;;
       abort();
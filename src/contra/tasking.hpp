@@ -95,6 +95,10 @@ public:
   virtual void setTopLevelTask(llvm::Module &, const TaskInfo &) = 0;
   virtual void startRuntime(llvm::Module &) = 0;
   virtual void stopRuntime(llvm::Module &) {}
+
+  virtual llvm::AllocaInst* createTrace(llvm::Module &) { return nullptr; }
+  virtual void beginTrace(llvm::Module &, llvm::AllocaInst*) {}
+  virtual void endTrace(llvm::Module &, llvm::AllocaInst*) {}
   
   virtual llvm::Value* launch(
       llvm::Module &,
@@ -175,6 +179,11 @@ public:
       llvm::Module &,
       llvm::Value*,
       llvm::Value*) = 0;
+  virtual llvm::AllocaInst* createBlockPartition(
+      llvm::Module &,
+      llvm::Value*,
+      llvm::Value*,
+      llvm::Value*);
   
   virtual llvm::Type* getPartitionType(llvm::Type*) const = 0;
   virtual bool isPartition(llvm::Type*) const = 0;
@@ -194,6 +203,18 @@ public:
   virtual void pushRootGuard(llvm::Module &) {};
   virtual void popRootGuard(llvm::Module &) {};
 
+  /// wait for all issued work, e.g. before reading a timer
+  virtual void fence(llvm::Module &) {};
+
+  /// can the task being generated allocate temporaries from an arena
+  virtual bool hasArena() const { return false; }
+
+  /// can index launches reduce into arrays element by element
+  virtual bool hasArrayReductions() const { return false; }
+
+  /// do reductions into task arguments need their own reduction ops
+  virtual bool needsArgReductionOps() const { return false; }
+
   
   //----------------------------------------------------------------------------
   // Common public members
@@ -241,6 +262,11 @@ public:
   // partition interface
   void destroyPartitions(llvm::Module &, const std::vector<llvm::Value*> &);
 
+  // reductions
+  llvm::Constant* initReduce(llvm::Type*, ReductionType);
+  llvm::Value* applyReduce(llvm::Module&, llvm::Value*, llvm::Value*, ReductionType);
+  llvm::Value* foldReduce(llvm::Module&, llvm::Value*, llvm::Value*, ReductionType);
+
 
 protected:
   
@@ -273,11 +299,6 @@ protected:
       llvm::Value*,
       llvm::Value* = nullptr);
 
-  // reductions
-  llvm::Constant* initReduce(llvm::Type*, ReductionType);
-  llvm::Value* applyReduce(llvm::Module&, llvm::Value*, llvm::Value*, ReductionType);
-  llvm::Value* foldReduce(llvm::Module&, llvm::Value*, llvm::Value*, ReductionType);
-
 };
 
 } // namespace
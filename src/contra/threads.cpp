@@ -1,3 +1,4 @@
+#include "args.hpp"
 #include "threads.hpp"
 
 #include "errors.hpp"
@@ -16,6 +17,13 @@ namespace contra {
 using namespace llvm;
 using namespace utils;
 
+cl::opt<int> OptionThreadsMaxTasks(
+    "threads-max-tasks",
+    cl::desc("Maximum number of tasks in flight before task calls run in "
+      "the caller (0 for the number of cores)"),
+    cl::init(0),
+    cl::cat(OptionCategory));
+
 //==============================================================================
 // Constructor
 //==============================================================================
@@ -27,6 +35,7 @@ ThreadsTasker::ThreadsTasker(utils::BuilderHelper & TheHelper)
   TaskInfoType_ = VoidPtrType_->getPointerTo();
   FieldType_ = createFieldType();
   AccessorType_ = createAccessorType();
+  FutureType_ = createFutureType();
 }
 
 //==============================================================================
@@ -48,9 +57,9 @@ StructType * ThreadsTasker::createFieldType()
 StructType * ThreadsTasker::createAccessorType()
 {
   std::vector<Type*> members = {
-    BoolType_,
     IntType_,
-    VoidPtrType_};
+    VoidPtrType_,
+    IntType_->getPointerTo()};
   auto NewType = StructType::create( TheContext_, members, "contra_threads_accessor_t" );
   return NewType;
 }
@@ -72,6 +81,16 @@ StructType * ThreadsTasker::createIndexPartitionType()
   return NewType;
 }
 
+//==============================================================================
+// Create the future type
+//==============================================================================
+StructType * ThreadsTasker::createFutureType()
+{
+  std::vector<Type*> members = { VoidPtrType_ };
+  auto NewType = StructType::create( TheContext_, members, "contra_threads_future_t" );
+  return NewType;
+}
+
 //==============================================================================
 // Create partitioninfo
 //==============================================================================
@@ -103,7 +122,11 @@ void ThreadsTasker::destroyTaskInfo(Module & TheModule, AllocaInst* PartA)
 //==============================================================================
 void ThreadsTasker::startRuntime(Module &TheModule)
 {
-  launch(TheModule, *TopLevelTask_);
+  AbstractTasker::launch(TheModule, *TopLevelTask_);
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_threads_wait_all",
+      VoidType_);
 }
 
 //==============================================================================
@@ -182,6 +205,15 @@ ThreadsTasker::PreambleResult ThreadsTasker::taskPreamble(
     auto & TaskE = getCurrentTask();
     TaskE.ResultAlloca = TheHelper_.getElementPointer(ArgsV, 0, ArgTs.size()-1);
   }
+
+  //----------------------------------------------------------------------------
+  // temporary arrays come from the worker's arena
+  getCurrentTask().ArenaMark = TheHelper_.callFunction(
+      TheModule,
+      "dopevector_arena_mark",
+      IntType_,
+      {},
+      "arena");
   
   //----------------------------------------------------------------------------
   // extract arguments
@@ -245,6 +277,12 @@ void ThreadsTasker::taskPostamble(
       Builder_.CreateStore(ResultV, TaskE.ResultAlloca);
     }
 
+    TheHelper_.callFunction(
+        TheModule,
+        "dopevector_arena_release",
+        VoidType_,
+        {getCurrentTask().ArenaMark});
+
     // always return null
     auto NullC = Constant::getNullValue(VoidPtrType_);
     Builder_.CreateRet(NullC);
@@ -262,8 +300,168 @@ void ThreadsTasker::taskPostamble(
     else {
       Builder_.CreateRetVoid();
     }
+
+    auto TaskF = Builder_.GetInsertBlock()->getParent();
+    if (isAsync(TaskF->getFunctionType()))
+      createAsyncEntry(TheModule, TaskF);
+  }
+
+}
+
+//==============================================================================
+// Can this type be passed to, or returned from, a spawned task
+//==============================================================================
+bool ThreadsTasker::isAsyncType(Type* Ty)
+{ return Ty->isIntegerTy() || Ty->isFloatingPointTy(); }
+
+//==============================================================================
+// Can this task be spawned asynchronously
+//==============================================================================
+bool ThreadsTasker::isAsync(FunctionType* TaskT) const
+{
+  auto ResultT = TaskT->getReturnType();
+  if (!ResultT->isVoidTy() && !isAsyncType(ResultT)) return false;
+  for (auto ParamT : TaskT->params())
+    if (!isAsyncType(ParamT)) return false;
+  return true;
+}
+
+//==============================================================================
+// The packed arguments of a spawned task, led by its future state
+//==============================================================================
+StructType* ThreadsTasker::getAsyncArgsType(FunctionType* TaskT) const
+{
+  std::vector<Type*> ArgTs = { VoidPtrType_ };
+  for (auto ParamT : TaskT->params()) ArgTs.emplace_back(ParamT);
+  return StructType::get(TheContext_, ArgTs);
+}
+
+static std::string getAsyncName(const std::string & Name)
+{ return "__" + Name + "_async__"; }
+
+//==============================================================================
+// Create the entry point of a spawned task
+//==============================================================================
+void ThreadsTasker::createAsyncEntry(Module &TheModule, Function* TaskF)
+{
+  auto TaskT = TaskF->getFunctionType();
+  auto EntryN = getAsyncName(TaskF->getName().str());
+
+  // recursive tasks already declared it when spawning themselves
+  auto EntryF = TheModule.getFunction(EntryN);
+  if (!EntryF) {
+    auto EntryT = FunctionType::get(VoidPtrType_, VoidPtrType_, false);
+    EntryF = Function::Create(
+        EntryT,
+        Function::ExternalLinkage,
+        EntryN,
+        &TheModule);
+  }
+  
+  auto BB = BasicBlock::Create(TheContext_, "entry", EntryF);
+  Builder_.SetInsertPoint(BB);
+
+  // unpack the arguments
+  auto ArgsT = getAsyncArgsType(TaskT);
+  auto ArgsV = TheHelper_.createBitCast(&*EntryF->arg_begin(), ArgsT->getPointerTo());
+  auto StateV = TheHelper_.load( TheHelper_.getElementPointer(ArgsV, 0, 0) );
+
+  std::vector<Value*> ArgVs;
+  for (unsigned i=0; i<TaskT->getNumParams(); ++i) {
+    auto ArgGEP = TheHelper_.getElementPointer(ArgsV, 0, i+1);
+    ArgVs.emplace_back( TheHelper_.load(ArgGEP) );
+  }
+
+  // run the task and fulfill its future
+  auto ResultV = Builder_.CreateCall(TaskF, ArgVs);
+
+  Value* DataV = Constant::getNullValue(VoidPtrType_);
+  Value* DataSizeV = llvmValue<int_t>(TheContext_, 0);
+  auto ResultT = TaskT->getReturnType();
+  if (!ResultT->isVoidTy()) {
+    auto ResultA = TheHelper_.createEntryBlockAlloca(EntryF, ResultT, "result");
+    Builder_.CreateStore(ResultV, ResultA);
+    DataV = TheHelper_.createBitCast(ResultA, VoidPtrType_);
+    DataSizeV = TheHelper_.getTypeSize<int_t>(ResultT);
+  }
+
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_threads_future_set",
+      VoidType_,
+      {StateV, DataV, DataSizeV});
+
+  TheHelper_.createFree(&*EntryF->arg_begin());
+  Builder_.CreateRet( Constant::getNullValue(VoidPtrType_) );
+}
+ 
+//==============================================================================
+// Launch a task
+//==============================================================================
+Value* ThreadsTasker::launch(
+    Module &TheModule,
+    const TaskInfo & TaskI,
+    const std::vector<Value*> & Args)
+{
+  auto TaskT = TaskI.getFunctionType();
+
+  // arguments are passed by value
+  std::vector<Value*> ArgVs;
+  for (unsigned i=0; i<Args.size(); ++i) {
+    auto ArgV = Args[i];
+    if (isFuture(ArgV))
+      ArgV = loadFuture(TheModule, ArgV, TaskT->getParamType(i));
+    ArgVs.emplace_back( TheHelper_.getAsValue(ArgV) );
   }
 
+  if (!isAsync(TaskT))
+    return AbstractTasker::launch(TheModule, TaskI, ArgVs);
+
+  //----------------------------------------------------------------------------
+  // Create the future
+  
+  AllocaInst* FutureA = nullptr;
+  Value* StateV = Constant::getNullValue(VoidPtrType_);
+
+  auto ResultT = TaskT->getReturnType();
+  if (!ResultT->isVoidTy()) {
+    FutureA = TheHelper_.createEntryBlockAlloca(FutureType_, "future");
+    TheHelper_.callFunction(
+        TheModule,
+        "contra_threads_future_create",
+        VoidType_,
+        {FutureA});
+    StateV = TheHelper_.load( TheHelper_.getElementPointer(FutureA, 0, 0) );
+  }
+  
+  //----------------------------------------------------------------------------
+  // Pack the arguments, freed by the task
+
+  auto ArgsT = getAsyncArgsType(TaskT);
+  auto ArgsSizeV = TheHelper_.getTypeSize<int_t>(ArgsT);
+  auto ArgsV = TheHelper_.createMalloc(ByteType_, ArgsSizeV, "args");
+  auto ArgsPtrV = TheHelper_.createBitCast(ArgsV, ArgsT->getPointerTo());
+
+  Builder_.CreateStore(StateV, TheHelper_.getElementPointer(ArgsPtrV, 0, 0));
+  for (unsigned i=0; i<ArgVs.size(); ++i)
+    Builder_.CreateStore(ArgVs[i], TheHelper_.getElementPointer(ArgsPtrV, 0, i+1));
+
+  //----------------------------------------------------------------------------
+  // Spawn the task
+
+  auto EntryT = FunctionType::get(VoidPtrType_, VoidPtrType_, false);
+  auto EntryF = TheModule.getOrInsertFunction(
+      getAsyncName(TaskI.getName()),
+      EntryT).getCallee();
+  auto MaxTasksV = llvmValue<int_t>(TheContext_, OptionThreadsMaxTasks);
+
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_threads_spawn",
+      VoidType_,
+      {EntryF, ArgsV, StateV, MaxTasksV});
+
+  return FutureA;
 }
  
 
@@ -322,12 +520,13 @@ Value* ThreadsTasker::launch(
   std::vector<Value*> ExpandedArgAs;
   ExpandedArgAs.reserve(NumArgs);
 
+  std::map<unsigned, const ArgReduction*> ArrayReductions;
+
   for (unsigned i=0; i<NumArgs; i++) {
-    ExpandedArgAs.emplace_back(ArgAs[i]);
 
     if (isField(ArgAs[i])) {
 
-      auto FieldA = TheHelper_.getAsAlloca(ArgAs[i]);
+      Value* FieldA = TheHelper_.getAsAlloca(ArgAs[i]);
       Value* IndexPartitionA = nullptr;
       if (PartAs[i]) {
         IndexPartitionA = TheHelper_.getAsAlloca(PartAs[i]);
@@ -342,8 +541,38 @@ Value* ThreadsTasker::launch(
         IndexPartitionA = TheHelper_.getAsAlloca(IndexPartitionV);
       }
 
+      // reductions go to private copies that are folded in at the join
+      if (auto ReduceI = TaskI.getArgReduction(i)) {
+        auto PrivFieldA = TheHelper_.createEntryBlockAlloca(FieldType_, "priv");
+        auto PrivPartA = TheHelper_.createEntryBlockAlloca(IndexPartitionType_, "priv");
+        auto OpV = llvmValue<int_t>(TheContext_, static_cast<int_t>(ReduceI->Op));
+        auto IsRealV = llvmValue<int_t>(
+            TheContext_,
+            ReduceI->DataType->isFloatingPointTy());
+        TheHelper_.callFunction(
+            TheModule,
+            "contra_threads_reduction_setup",
+            VoidType_,
+            {FieldA, IndexPartitionA, OpV, IsRealV, PrivFieldA, PrivPartA, TaskInfoA});
+        FieldA = PrivFieldA;
+        IndexPartitionA = PrivPartA;
+      }
+      else if (isWrite(TaskI.getArgAccess(i))) {
+        TheHelper_.callFunction(
+            TheModule,
+            "contra_threads_partition_check_write",
+            VoidType_,
+            {IndexPartitionA});
+      }
+
+      ExpandedArgAs.emplace_back(FieldA);
       ExpandedArgAs.emplace_back(IndexPartitionA);
     } // field
+    else {
+      if (auto ReduceI = TaskI.getArgReduction(i))
+        ArrayReductions.emplace(ExpandedArgAs.size(), ReduceI);
+      ExpandedArgAs.emplace_back(ArgAs[i]);
+    }
   }
 
   NumArgs = ExpandedArgAs.size();
@@ -428,7 +657,29 @@ Value* ThreadsTasker::launch(
 
   for (unsigned i=0; i<NumArgs; ++i) {
     auto ArgA = TheHelper_.getElementPointer(ThreadArgsV, {0, i});
-    auto ArgV = TheHelper_.getAsValue(ExpandedArgAs[i]);
+    Value* ArgV = nullptr;
+    // each point reduces into a private copy of the array
+    auto it = ArrayReductions.find(i);
+    if (it != ArrayReductions.end()) {
+      auto ReduceI = it->second;
+      auto ArrayA = TheHelper_.getAsAlloca(ExpandedArgAs[i]);
+      auto PrivA = TheHelper_.createEntryBlockAlloca(
+          TheHelper_.getAllocatedType(ArrayA),
+          "priv");
+      auto OpV = llvmValue<int_t>(TheContext_, static_cast<int_t>(ReduceI->Op));
+      auto IsRealV = llvmValue<int_t>(
+          TheContext_,
+          ReduceI->DataType->isFloatingPointTy());
+      TheHelper_.callFunction(
+          TheModule,
+          "contra_threads_array_reduction_setup",
+          VoidType_,
+          {ArrayA, OpV, IsRealV, PrivA, TaskInfoA});
+      ArgV = TheHelper_.load(PrivA);
+    }
+    else {
+      ArgV = TheHelper_.getAsValue(ExpandedArgAs[i]);
+    }
     Builder_.CreateStore(ArgV, ArgA);
   }
 
@@ -680,6 +931,32 @@ AllocaInst* ThreadsTasker::createPartition(
   return IndexPartA;
 }
 
+//==============================================================================
+// create a block partition
+//==============================================================================
+AllocaInst* ThreadsTasker::createBlockPartition(
+    Module & TheModule,
+    Value* IndexSpaceA,
+    Value* DimsA,
+    Value* BlocksA)
+{
+  auto IndexPartA = TheHelper_.createEntryBlockAlloca(IndexPartitionType_);
+
+  std::vector<Value*> FunArgVs = {
+    TheHelper_.getAsAlloca(DimsA),
+    TheHelper_.getAsAlloca(BlocksA),
+    TheHelper_.getAsAlloca(IndexSpaceA),
+    IndexPartA};
+  
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_threads_partition_from_blocks",
+      VoidType_,
+      FunArgVs);
+
+  return IndexPartA;
+}
+
 //==============================================================================
 // Is this a field type
 //==============================================================================
@@ -859,6 +1136,90 @@ void ThreadsTasker::destroyPartition(
       VoidType_,
       FunArgVs);
 }
+
+//==============================================================================
+// Is this a future type
+//==============================================================================
+bool ThreadsTasker::isFuture(Value* FutureA) const
+{
+  auto FutureT = FutureA->getType();
+  if (isa<AllocaInst>(FutureA)) FutureT = FutureT->getPointerElementType();
+  return (FutureT == FutureType_);
+}
+
+//==============================================================================
+// Wait on a future and load its value
+//==============================================================================
+Value* ThreadsTasker::loadFuture(
+    Module &TheModule,
+    Value* FutureV,
+    Type *DataT)
+{
+  // synchronous launches return plain values
+  if (!isFuture(FutureV)) return FutureV;
+
+  auto FutureA = TheHelper_.getAsAlloca(FutureV);
+  auto DataA = TheHelper_.createEntryBlockAlloca(DataT);
+  auto DataPtrV = TheHelper_.createBitCast(DataA, VoidPtrType_);
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_threads_future_wait",
+      VoidType_,
+      {FutureA, DataPtrV});
+  return TheHelper_.load(DataA);
+}
+
+//==============================================================================
+// destroy a future
+//==============================================================================
+void ThreadsTasker::destroyFuture(Module &TheModule, Value* FutureA)
+{
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_threads_future_destroy",
+      VoidType_,
+      {FutureA});
+}
+
+//==============================================================================
+// Create a ready future from a value
+//==============================================================================
+void ThreadsTasker::toFuture(
+    Module & TheModule,
+    Value* ValueV,
+    Value* FutureA)
+{
+  ValueV = TheHelper_.getAsValue(ValueV);
+  auto ValueT = ValueV->getType();
+  auto ValueA = TheHelper_.createEntryBlockAlloca(ValueT);
+  Builder_.CreateStore( ValueV, ValueA );
+
+  auto ValuePtrV = TheHelper_.createBitCast(ValueA, VoidPtrType_);
+  auto ValueSizeV = TheHelper_.getTypeSize<int_t>(ValueT);
+
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_threads_future_from_value",
+      VoidType_,
+      {ValuePtrV, ValueSizeV, FutureA});
+}
+
+//==============================================================================
+// Share a future
+//==============================================================================
+void ThreadsTasker::copyFuture(
+    Module & TheModule,
+    Value* ValueV,
+    Value* FutureA)
+{
+  auto ValueA = TheHelper_.getAsAlloca(ValueV);
+  TheHelper_.callFunction(
+      TheModule,
+      "contra_threads_future_copy",
+      VoidType_,
+      {ValueA, FutureA});
+}
+
 //==============================================================================
 // create a reduction op
 //==============================================================================
@@ -45,6 +45,7 @@ class ThreadsTasker : public AbstractTasker {
   llvm::StructType* AccessorType_ = nullptr;
   llvm::StructType* IndexSpaceType_ = nullptr;
   llvm::StructType* IndexPartitionType_ = nullptr;
+  llvm::StructType* FutureType_ = nullptr;
 
   llvm::Type* TaskInfoType_ = nullptr;
 
@@ -52,6 +53,7 @@ class ThreadsTasker : public AbstractTasker {
   
   struct TaskEntry {
     llvm::Value* ResultAlloca = nullptr;
+    llvm::Value* ArenaMark = nullptr;
   };
 
   std::forward_list<TaskEntry> TaskAllocas_;
@@ -74,8 +76,13 @@ public:
       llvm::Value*,
       bool) override;
 
+  virtual bool hasArena() const override
+  { return !TaskAllocas_.empty(); }
   
-  using AbstractTasker::launch;
+  virtual llvm::Value* launch(
+      llvm::Module &,
+      const TaskInfo &,
+      const std::vector<llvm::Value*> & = {}) override;
   
   virtual llvm::Value* launch(
       llvm::Module &,
@@ -96,6 +103,21 @@ public:
       const std::vector<llvm::Type*> &,
       const std::vector<ReductionType> &) override;
 
+  virtual bool hasArrayReductions() const override { return true; }
+
+  // only tasks that can be spawned return futures
+  virtual llvm::Type* getFutureType(llvm::Type* Ty) const override
+  { return isAsyncType(Ty) ? FutureType_ : Ty; }
+
+  virtual bool isFuture(llvm::Value*) const override;
+  virtual llvm::Value* loadFuture(
+      llvm::Module &,
+      llvm::Value*,
+      llvm::Type*) override;
+  virtual void destroyFuture(llvm::Module &, llvm::Value*) override;
+  virtual void toFuture(llvm::Module &, llvm::Value*, llvm::Value*) override;
+  virtual void copyFuture(llvm::Module &, llvm::Value*, llvm::Value*) override;
+
   
   virtual llvm::AllocaInst* createPartition(
       llvm::Module &,
@@ -106,6 +128,11 @@ public:
       llvm::Module &,
       llvm::Value*,
       llvm::Value*) override;
+  virtual llvm::AllocaInst* createBlockPartition(
+      llvm::Module &,
+      llvm::Value*,
+      llvm::Value*,
+      llvm::Value*) override;
   
   virtual llvm::Type* getPartitionType(llvm::Type*) const override
   { return IndexPartitionType_; }
@@ -159,6 +186,12 @@ protected:
   llvm::StructType* createFieldType();
   llvm::StructType* createAccessorType();
   llvm::StructType* createIndexPartitionType();
+  llvm::StructType* createFutureType();
+
+  static bool isAsyncType(llvm::Type*);
+  bool isAsync(llvm::FunctionType*) const;
+  llvm::StructType* getAsyncArgsType(llvm::FunctionType*) const;
+  void createAsyncEntry(llvm::Module &, llvm::Function*);
 
   llvm::AllocaInst* createTaskInfo(llvm::Module &);
   void destroyTaskInfo(llvm::Module &, llvm::AllocaInst*);
@@ -1,11 +1,43 @@
+#include "blocks_rt.hpp"
+#include "reduce_rt.hpp"
 #include "threads_rt.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
+#include <thread>
 
 using namespace contra;
 
+namespace {
+
+/// number of spawned tasks that have not finished yet
+std::atomic<int_t> ActiveTasks(0);
+std::mutex ActiveMutex;
+std::condition_variable ActiveDone;
+
+/// arguments of a spawned task
+struct threads_spawn_args_t {
+  void*(*fptr)(void*);
+  void * args;
+};
+
+/// run a spawned task and account for its completion
+void * threads_spawn_entry(void * data)
+{
+  auto spawn = static_cast<threads_spawn_args_t*>(data);
+  spawn->fptr(spawn->args);
+  delete spawn;
+  if (--ActiveTasks == 0) {
+    std::lock_guard<std::mutex> lock(ActiveMutex);
+    ActiveDone.notify_all();
+  }
+  return nullptr;
+}
+
+} // namespace
+
 extern "C" {
   
 //==============================================================================
@@ -142,6 +174,45 @@ void contra_threads_partition_from_array(
   //------------------------------------
 }
 
+//==============================================================================
+/// block partition of a row-major index space
+//==============================================================================
+void contra_threads_partition_from_blocks(
+    dopevector_t * dims_arr,
+    dopevector_t * blocks_arr,
+    contra_index_space_t * is,
+    contra_threads_partition_t * part)
+{
+  int_t num_parts;
+  int_t * indices;
+  int_t * offsets;
+  contra::blockPartition(
+      static_cast<const int_t*>(dims_arr->data),
+      dims_arr->size,
+      static_cast<const int_t*>(blocks_arr->data),
+      blocks_arr->size,
+      is->size(),
+      num_parts,
+      indices,
+      offsets);
+
+  part->setup(is->size(), num_parts, is, indices, offsets);
+}
+
+//==============================================================================
+/// Partitions built from fields or blocks may overlap, and they are only
+/// views of the field on the distributed backends, so tasks may read or
+/// reduce through them but never write.
+//==============================================================================
+void contra_threads_partition_check_write(contra_threads_partition_t * part)
+{
+  if (part->indices) {
+    std::cerr << "Tasks can not write to fields through partitions built "
+      << "from fields or blocks." << std::endl;
+    abort();
+  }
+}
+
 //==============================================================================
 /// index space creation
 //==============================================================================
@@ -230,15 +301,8 @@ void contra_threads_accessor_setup(
   auto data_size = fld->data_size;
 
   if (part->indices) {
-    auto size = part->size(i);
-    acc->setup( size, data_size );
-    auto dest = static_cast<byte_t*>(acc->data);
     auto off = part->offsets[i];
-    for (int_t j=0; j<size; ++j) {
-      const auto src = fld_data + data_size*part->indices[off + j];
-      memcpy(dest, src, data_size);
-      dest += data_size;
-    }
+    acc->setup( fld_data, data_size, part->indices + off );
   }
   else {
     auto offsets = part->offsets;
@@ -254,8 +318,7 @@ void contra_threads_accessor_write(
     const void * data,
     int_t index)
 {
-  byte_t * offset = static_cast<byte_t*>(acc->data) + acc->data_size*index;
-  memcpy(offset, data, acc->data_size);
+  memcpy(acc->at(index), data, acc->data_size);
 }
 
 //==============================================================================
@@ -266,8 +329,7 @@ void contra_threads_accessor_read(
     void * data,
     int_t index)
 {
-  const byte_t * offset = static_cast<const byte_t*>(acc->data) + acc->data_size*index;
-  memcpy(data, offset, acc->data_size);
+  memcpy(data, acc->at(index), acc->data_size);
 }
 
 //==============================================================================
@@ -277,6 +339,55 @@ void contra_threads_accessor_destroy(
     contra_threads_accessor_t * acc)
 { acc->destroy(); }
 
+//==============================================================================
+/// Give the index points a private copy of a field to reduce into
+//==============================================================================
+void contra_threads_reduction_setup(
+    contra_threads_field_t * fld,
+    contra_threads_partition_t * part,
+    int_t op,
+    int_t is_real,
+    contra_threads_field_t * priv_fld,
+    contra_threads_partition_t * priv_part,
+    contra_threads_task_info_t **info)
+{
+  auto data_size = fld->data_size;
+  auto num_parts = part->num_parts;
+  auto size = part->offsets[num_parts];
+
+  // entries are laid out point after point, even when points overlap
+  auto data = malloc(data_size*size);
+  reduceInit(data, size, op, data_size, is_real);
+
+  priv_fld->data_size = data_size;
+  priv_fld->data = data;
+  priv_fld->index_space = fld->index_space;
+  priv_part->setup(size, num_parts, part->index_space, part->offsets);
+
+  (*info)->Reductions.emplace_back(
+      contra_threads_reduction_t{fld, part, data, op, static_cast<bool>(is_real)});
+}
+
+//==============================================================================
+/// Give an index point a private copy of an array to reduce into
+//==============================================================================
+void contra_threads_array_reduction_setup(
+    dopevector_t * arr,
+    int_t op,
+    int_t is_real,
+    dopevector_t * priv_arr,
+    contra_threads_task_info_t **info)
+{
+  auto size = arr->size;
+  auto data_size = arr->data_size;
+  auto data = malloc(size*data_size);
+  reduceInit(data, size, op, data_size, is_real);
+  priv_arr->setup(size, data_size, data);
+
+  (*info)->ArrayReductions.emplace_back(
+      contra_threads_array_reduction_t{arr, data, op, static_cast<bool>(is_real)});
+}
+
 //==============================================================================
 /// Launch threads
 //==============================================================================
@@ -309,6 +420,143 @@ void contra_threads_join(contra_threads_task_info_t **info)
       std::cerr << "Error joining thread." << std::endl;
       abort();
     }
+
+  // fold the private copies into their fields
+  for (auto & red : (*info)->Reductions) {
+    auto part = red.part;
+    auto data_size = red.field->data_size;
+    auto fld_data = static_cast<byte_t*>(red.field->data);
+    auto priv_data = static_cast<const byte_t*>(red.data);
+    auto size = part->offsets[part->num_parts];
+    if (part->indices) {
+      for (int_t j=0; j<size; ++j)
+        reduceApply(
+            fld_data + data_size*part->indices[j],
+            priv_data + data_size*j,
+            1,
+            red.op,
+            data_size,
+            red.is_real);
+    }
+    else {
+      reduceApply(fld_data, priv_data, size, red.op, data_size, red.is_real);
+    }
+    free(red.data);
+  }
+  (*info)->Reductions.clear();
+  
+  // and every point's array into the original
+  for (auto & red : (*info)->ArrayReductions) {
+    auto arr = red.array;
+    reduceApply(arr->data, red.data, arr->size, red.op, arr->data_size, red.is_real);
+    free(red.data);
+  }
+  (*info)->ArrayReductions.clear();
+}
+
+//==============================================================================
+/// Create a pending future
+//==============================================================================
+void contra_threads_future_create(contra_threads_future_t * fut)
+{ fut->state = new threads_future_state_t(1); }
+
+//==============================================================================
+/// Create a ready future from a value
+//==============================================================================
+void contra_threads_future_from_value(
+    const void * data,
+    int_t data_size,
+    contra_threads_future_t * fut)
+{
+  fut->state = new threads_future_state_t(1);
+  fut->state->set(data, data_size);
+}
+
+//==============================================================================
+/// Fulfill a future and drop the task's reference to it
+//==============================================================================
+void contra_threads_future_set(
+    threads_future_state_t * state,
+    const void * data,
+    int_t data_size)
+{
+  if (!state) return;
+  state->set(data, data_size);
+  state->release();
+}
+
+//==============================================================================
+/// Wait on a future
+//==============================================================================
+void contra_threads_future_wait(
+    contra_threads_future_t * fut,
+    void * data)
+{ fut->state->get(data); }
+
+//==============================================================================
+/// Share a future
+//==============================================================================
+void contra_threads_future_copy(
+    contra_threads_future_t * src,
+    contra_threads_future_t * dest)
+{
+  src->state->retain();
+  dest->state = src->state;
+}
+
+//==============================================================================
+/// Destroy a future
+//==============================================================================
+void contra_threads_future_destroy(contra_threads_future_t * fut)
+{
+  if (fut->state) fut->state->release();
+  fut->state = nullptr;
+}
+
+//==============================================================================
+/// Spawn a task, or run it in place once enough tasks are in flight
+//==============================================================================
+void contra_threads_spawn(
+    void*(*fptr)(void*),
+    void * args,
+    threads_future_state_t * state,
+    int_t max_tasks)
+{
+  if (max_tasks <= 0)
+    max_tasks = std::max<int_t>(std::thread::hardware_concurrency(), 1);
+
+  // the task holds its own reference, released once the result is set
+  if (state) state->retain();
+
+  // once enough tasks are in flight, the caller runs the task itself so
+  // that tasks blocked on futures cannot exhaust the threads
+  if (++ActiveTasks > max_tasks) {
+    ActiveTasks--;
+    fptr(args);
+    return;
+  }
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  pthread_t t;
+  auto spawn = new threads_spawn_args_t{fptr, args};
+  if(pthread_create(&t, &attr, threads_spawn_entry, spawn)) {
+    std::cerr << "Error creating thread." << std::endl;
+    abort();
+  }
+
+  pthread_attr_destroy(&attr);
+}
+
+//==============================================================================
+/// Wait for all spawned tasks
+//==============================================================================
+void contra_threads_wait_all()
+{
+  std::unique_lock<std::mutex> lock(ActiveMutex);
+  ActiveDone.wait(lock, []{ return ActiveTasks == 0; });
 }
 
 } // extern
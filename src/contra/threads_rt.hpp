@@ -6,8 +6,12 @@
 
 #include "librt/dopevector.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <vector>
 
 namespace contra {
@@ -16,6 +20,41 @@ namespace contra {
 /// Threading runtime
 ////////////////////////////////////////////////////////////////////////////////
 
+//==============================================================================
+/// Shared state of a future, released by its last owner
+//==============================================================================
+class threads_future_state_t {
+
+  std::mutex Mutex_;
+  std::condition_variable Ready_;
+  bool IsReady_ = false;
+  std::vector<byte_t> Data_;
+  std::atomic<int_t> Refs_;
+
+public:
+
+  threads_future_state_t(int_t Refs) : Refs_(Refs) {}
+
+  void set(const void * Data, int_t Size) {
+    {
+      std::lock_guard<std::mutex> Lock(Mutex_);
+      auto Ptr = static_cast<const byte_t*>(Data);
+      Data_.assign(Ptr, Ptr+Size);
+      IsReady_ = true;
+    }
+    Ready_.notify_all();
+  }
+
+  void get(void * Data) {
+    std::unique_lock<std::mutex> Lock(Mutex_);
+    Ready_.wait(Lock, [this]{ return IsReady_; });
+    std::copy(Data_.begin(), Data_.end(), static_cast<byte_t*>(Data));
+  }
+
+  void retain() { Refs_++; }
+  void release() { if (--Refs_ == 0) delete this; }
+};
+
 } // namespace
 
 extern "C" {
@@ -104,35 +143,62 @@ struct contra_threads_field_t {
 
 //==============================================================================
 struct contra_threads_accessor_t {
-  bool is_allocated;
   int_t data_size;
   void *data;
+  const int_t *indices;
   
-  void setup(void * ptr, int_t data_sz) {
-    is_allocated = false;
+  void setup(void * ptr, int_t data_sz, const int_t * indx = nullptr) {
     data_size = data_sz;
     data = ptr;
+    indices = indx;
   }
 
-  void setup(int_t size, int_t data_sz) {
-    is_allocated = true;
-    data_size = data_sz;  
-    data = malloc(size * data_size);
+  /// indexed partitions read and write the field in place
+  byte_t * at(int_t index) {
+    if (indices) index = indices[index];
+    return static_cast<byte_t*>(data) + data_size*index;
   }
   
   void destroy() {
-    if (is_allocated) free(data);
-    is_allocated = false;
     data_size = 0;
     data = nullptr;
+    indices = nullptr;
   }
 };
 
 
+//==============================================================================
+struct contra_threads_future_t {
+  contra::threads_future_state_t * state;
+};
+
+//==============================================================================
+/// Private copy of a field that index points reduce into
+//==============================================================================
+struct contra_threads_reduction_t {
+  contra_threads_field_t * field;
+  contra_threads_partition_t * part;
+  void * data;
+  int_t op;
+  bool is_real;
+};
+
+//==============================================================================
+/// Private copy of an array that one index point reduces into
+//==============================================================================
+struct contra_threads_array_reduction_t {
+  dopevector_t * array;
+  void * data;
+  int_t op;
+  bool is_real;
+};
+
 //==============================================================================
 struct contra_threads_task_info_t {
   std::map<contra_index_space_t*, contra_threads_partition_t*> IndexPartMap;
   std::vector<contra_threads_partition_t*> PartsToDelete;
+  std::vector<contra_threads_reduction_t> Reductions;
+  std::vector<contra_threads_array_reduction_t> ArrayReductions;
 
   std::vector<std::unique_ptr<pthread_t>> Threads;
 
@@ -163,6 +229,10 @@ struct contra_threads_task_info_t {
   ~contra_threads_task_info_t() {
     for (auto part : PartsToDelete)
       part->destroy();
+    for (auto & red : Reductions)
+      free(red.data);
+    for (auto & red : ArrayReductions)
+      free(red.data);
   }
 };
 
@@ -177,6 +247,13 @@ void contra_threads_partition_from_size(
     contra_index_space_t * is,
     contra_threads_partition_t * part);
 
+/// block partition of a row-major index space
+void contra_threads_partition_from_blocks(
+    dopevector_t * dims,
+    dopevector_t * blocks,
+    contra_index_space_t * is,
+    contra_threads_partition_t * part);
+
 
 } // extern
 
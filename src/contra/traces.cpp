@@ -0,0 +1,85 @@
+#include "traces.hpp"
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+// Vizitors
+////////////////////////////////////////////////////////////////////////////////
+
+//==============================================================================
+void TraceIdentifier::visit(ForStmtAST& e)
+{
+  e.getStartExpr()->accept(*this);
+
+  auto OldLaunches = NumLaunches_;
+
+  IsTraceable_ = true;
+  NumLaunches_ = 0;
+  for (auto & Stmt : e.getBodyExprs()) Stmt->accept(*this);
+  e.setTraceable(IsTraceable_ && NumLaunches_ > 0);
+  
+  // traces cannot be nested, so the enclosing loop is left alone
+  IsTraceable_ = false;
+  NumLaunches_ = OldLaunches;
+}
+
+//==============================================================================
+bool TraceIdentifier::preVisit(ForeachStmtAST& e)
+{
+  // the body of a lifted loop runs inside its own task
+  if (e.isLifted()) NumLaunches_++;
+  else IsTraceable_ = false;
+  return true;
+}
+
+//==============================================================================
+bool TraceIdentifier::preVisit(IfStmtAST&)
+{
+  IsTraceable_ = false;
+  return true;
+}
+
+//==============================================================================
+bool TraceIdentifier::preVisit(BreakStmtAST&)
+{
+  IsTraceable_ = false;
+  return true;
+}
+
+//==============================================================================
+bool TraceIdentifier::preVisit(PartitionStmtAST&)
+{
+  IsTraceable_ = false;
+  return true;
+}
+
+//==============================================================================
+void TraceIdentifier::postVisit(CallExprAST& e)
+{
+  if (e.getFunctionDef()->isTask() && !e.isInlined()) NumLaunches_++;
+  // creating partitions cannot be replayed
+  const auto & Name = e.getName();
+  if (Name == "part" || Name == "blocks") IsTraceable_ = false;
+}
+
+//==============================================================================
+void TraceIdentifier::postVisit(ArrayAccessExprAST& e)
+{
+  // single values of a field need an inline mapping
+  auto VarDef = e.getVariableDef();
+  if (VarDef && VarDef->isField()) IsTraceable_ = false;
+}
+
+//==============================================================================
+void TraceIdentifier::postVisit(AssignStmtAST& e)
+{
+  // creating or filling whole fields cannot be replayed
+  for (const auto & Left : e.getLeftExprs()) {
+    auto LeftExpr = dynamic_cast<VarAccessExprAST*>(Left.get());
+    if (!LeftExpr) continue;
+    auto VarDef = LeftExpr->getVariableDef();
+    if (VarDef && VarDef->isField()) IsTraceable_ = false;
+  }
+}
+
+} // namespace
@@ -0,0 +1,39 @@
+#ifndef CONTRA_TRACES_HPP
+#define CONTRA_TRACES_HPP
+
+#include "config.hpp"
+#include "recursive.hpp"
+
+namespace contra {
+
+////////////////////////////////////////////////////////////////////////////////
+/// Identifies loops that issue the same launches every iteration
+////////////////////////////////////////////////////////////////////////////////
+class TraceIdentifier : public RecursiveAstVisiter {
+
+  bool IsTraceable_ = false;
+  unsigned NumLaunches_ = 0;
+  
+public:
+
+  void runVisitor(FunctionAST&e)
+  {
+    IsTraceable_ = false;
+    NumLaunches_ = 0;
+    e.accept(*this);
+  }
+  
+  void visit(ForStmtAST& e) override;
+  bool preVisit(ForeachStmtAST& e) override;
+  bool preVisit(IfStmtAST& e) override;
+  bool preVisit(BreakStmtAST& e) override;
+  bool preVisit(PartitionStmtAST& e) override;
+  void postVisit(CallExprAST& e) override;
+  void postVisit(ArrayAccessExprAST& e) override;
+  void postVisit(AssignStmtAST& e) override;
+
+};
+
+} // namespace
+
+#endif // CONTRA_TRACES_HPP
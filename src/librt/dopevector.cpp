@@ -6,6 +6,117 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+//==============================================================================
+/// A chunk of arena memory
+//==============================================================================
+struct ArenaChunk {
+  char * Data = nullptr;
+  std::size_t Capacity = 0;
+  std::size_t Begin = 0;
+};
+
+//==============================================================================
+/// Chunks given back by arenas of threads that have finished
+//==============================================================================
+class ArenaChunkPool {
+
+  std::mutex Mutex_;
+  std::vector<ArenaChunk> Chunks_;
+
+public:
+
+  ~ArenaChunkPool()
+  { for (auto & C : Chunks_) free(C.Data); }
+
+  ArenaChunk take(std::size_t Bytes)
+  {
+    {
+      std::lock_guard<std::mutex> Lock(Mutex_);
+      for (auto it = Chunks_.begin(); it != Chunks_.end(); ++it) {
+        if (it->Capacity < Bytes) continue;
+        auto C = *it;
+        Chunks_.erase(it);
+        return C;
+      }
+    }
+    ArenaChunk C;
+    C.Capacity = Bytes;
+    C.Data = static_cast<char*>(malloc(C.Capacity));
+    return C;
+  }
+
+  void give(std::vector<ArenaChunk> & Chunks)
+  {
+    std::lock_guard<std::mutex> Lock(Mutex_);
+    Chunks_.insert(Chunks_.end(), Chunks.begin(), Chunks.end());
+    Chunks.clear();
+  }
+};
+
+ArenaChunkPool ChunkPool;
+
+//==============================================================================
+/// A bump allocator made of chunks that are kept for reuse
+//==============================================================================
+class DopeVectorArena {
+
+  static constexpr std::size_t ChunkSize = 1 << 16;
+  static constexpr std::size_t Alignment = 16;
+
+  std::vector<ArenaChunk> Chunks_;
+  std::size_t Current_ = 0;
+  std::size_t Offset_ = 0;
+
+public:
+
+  // threads are short lived, so their chunks go back to a shared pool
+  ~DopeVectorArena()
+  { ChunkPool.give(Chunks_); }
+
+  void* allocate(std::size_t Bytes)
+  {
+    Bytes = (Bytes + Alignment - 1) / Alignment * Alignment;
+    // skip over any chunks without enough room left
+    while (Current_ < Chunks_.size() && Offset_+Bytes > Chunks_[Current_].Capacity) {
+      Current_++;
+      Offset_ = 0;
+    }
+    if (Current_ == Chunks_.size()) {
+      auto C = ChunkPool.take(Bytes > ChunkSize ? Bytes : ChunkSize);
+      C.Begin = 0;
+      if (Current_) C.Begin = Chunks_.back().Begin + Chunks_.back().Capacity;
+      Chunks_.emplace_back(C);
+    }
+    auto Ptr = Chunks_[Current_].Data + Offset_;
+    Offset_ += Bytes;
+    return Ptr;
+  }
+
+  std::size_t mark() const
+  {
+    if (Current_ == Chunks_.size()) return 0;
+    return Chunks_[Current_].Begin + Offset_;
+  }
+
+  void release(std::size_t Mark)
+  {
+    Current_ = 0;
+    Offset_ = Mark;
+    while (Current_+1 < Chunks_.size() && Chunks_[Current_+1].Begin <= Mark) {
+      Current_++;
+      Offset_ = Mark - Chunks_[Current_].Begin;
+    }
+  }
+};
+
+thread_local DopeVectorArena Arena;
+
+} // namespace
 
 extern "C" {
 
@@ -31,6 +142,29 @@ void dopevector_deallocate(dopevector_t * dv)
   dv->data_size = 0;
 }
 
+//==============================================================================
+/// memory allocation from the arena
+//==============================================================================
+void dopevector_arena_allocate(int_t size, int_t data_size, dopevector_t * dv)
+{
+  dv->data = Arena.allocate(size*data_size);
+  dv->size = size;
+  dv->capacity = size;
+  dv->data_size = data_size;
+}
+
+//==============================================================================
+/// arena mark
+//==============================================================================
+int_t dopevector_arena_mark()
+{ return Arena.mark(); }
+
+//==============================================================================
+/// arena release
+//==============================================================================
+void dopevector_arena_release(int_t mark)
+{ Arena.release(mark); }
+
 //==============================================================================
 /// copy
 //==============================================================================
@@ -46,6 +180,19 @@ void dopevector_copy(dopevector_t * src, dopevector_t * tgt)
   memcpy(tgt->data, src->data, len);
 }
 
+//==============================================================================
+/// move
+//==============================================================================
+void dopevector_move(dopevector_t * src, dopevector_t * tgt)
+{
+  if (src == tgt) return;
+  free(tgt->data);
+  *tgt = *src;
+  src->data = nullptr;
+  src->size = 0;
+  src->capacity = 0;
+}
+
 } // extern
 
 namespace librt {
@@ -58,6 +205,8 @@ StructType* DopeVector::DopeVectorType = nullptr;
 const std::string DopeVectorAllocate::Name = "dopevector_allocate";
 const std::string DopeVectorDeAllocate::Name = "dopevector_deallocate";
 const std::string DopeVectorCopy::Name = "dopevector_copy";
+const std::string DopeVectorMove::Name = "dopevector_move";
+const std::string DopeVectorArenaAllocate::Name = "dopevector_arena_allocate";
 
 //==============================================================================
 // Create the dopevector type 
@@ -112,6 +261,25 @@ Function *DopeVectorAllocate::install(LLVMContext & TheContext, Module & TheModu
 std::unique_ptr<FunctionDef> DopeVectorAllocate::check()
 { return std::unique_ptr<BuiltInFunction>(nullptr); }
 
+//==============================================================================
+// Installs the arena allocate function
+//==============================================================================
+Function *DopeVectorArenaAllocate::install(LLVMContext & TheContext, Module & TheModule)
+{
+  auto IntType = llvmType<int_t>(TheContext);
+  auto VoidType = Type::getVoidTy(TheContext);
+
+  std::vector<Type*> Args = {IntType, IntType, DopeVectorType->getPointerTo()};
+  auto AllocateType = FunctionType::get( VoidType, Args, false );
+
+  auto AllocateFun = Function::Create(AllocateType, Function::InternalLinkage,
+      DopeVectorArenaAllocate::Name, TheModule);
+  return AllocateFun;
+}
+
+std::unique_ptr<FunctionDef> DopeVectorArenaAllocate::check()
+{ return std::unique_ptr<BuiltInFunction>(nullptr); }
+
 //==============================================================================
 // Installs the Allocate deallocate function
 //==============================================================================
@@ -150,4 +318,23 @@ Function *DopeVectorCopy::install(LLVMContext & TheContext, Module & TheModule)
 std::unique_ptr<FunctionDef> DopeVectorCopy::check()
 { return std::unique_ptr<BuiltInFunction>(nullptr); }
 
+//==============================================================================
+// Installs the move function
+//==============================================================================
+Function *DopeVectorMove::install(LLVMContext & TheContext, Module & TheModule)
+{
+  auto VoidType = Type::getVoidTy(TheContext);
+
+  auto DopeVectorPtrType = DopeVectorType->getPointerTo();
+  std::vector<Type*> Args = {DopeVectorPtrType, DopeVectorPtrType};
+  auto FunT = FunctionType::get( VoidType, Args, false );
+
+  auto FunF = Function::Create(FunT, Function::InternalLinkage, DopeVectorMove::Name, TheModule);
+  
+  return FunF;
+}
+
+std::unique_ptr<FunctionDef> DopeVectorMove::check()
+{ return std::unique_ptr<BuiltInFunction>(nullptr); }
+
 }
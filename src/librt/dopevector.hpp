@@ -36,6 +36,18 @@ DLLEXPORT void dopevector_deallocate(dopevector_t * dv);
 /// memory deallocation
 DLLEXPORT void dopevector_copy(dopevector_t * src, dopevector_t * tgt);
 
+/// steal the memory of a dead dopevector
+DLLEXPORT void dopevector_move(dopevector_t * src, dopevector_t * tgt);
+
+/// memory allocation from the calling thread's arena
+DLLEXPORT void dopevector_arena_allocate(int_t size, int_t data_size, dopevector_t * dv);
+
+/// remember the top of the calling thread's arena
+DLLEXPORT int_t dopevector_arena_mark();
+
+/// give back everything allocated from the arena since the mark
+DLLEXPORT void dopevector_arena_release(int_t mark);
+
 } // extern
 
 namespace contra {
@@ -69,6 +81,18 @@ struct DopeVectorCopy : public DopeVector {
   static std::unique_ptr<contra::FunctionDef> check();
 };
 
+struct DopeVectorMove : public DopeVector {
+  static const std::string Name;
+  static llvm::Function *install(llvm::LLVMContext &, llvm::Module &);
+  static std::unique_ptr<contra::FunctionDef> check();
+};
+
+struct DopeVectorArenaAllocate : public DopeVector {
+  static const std::string Name;
+  static llvm::Function *install(llvm::LLVMContext &, llvm::Module &);
+  static std::unique_ptr<contra::FunctionDef> check();
+};
+
 } // namespace
 
 
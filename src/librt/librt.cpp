@@ -29,6 +29,8 @@ void RunTimeLib::setup(llvm::LLVMContext & TheContext)
       DopeVectorAllocate,
       DopeVectorDeAllocate, 
       DopeVectorCopy,
+      DopeVectorMove,
+      DopeVectorArenaAllocate,
       CAbs,
       CMax,
       CMin,
@@ -29,6 +29,12 @@ Value* BuilderHelper::createCast(Value* FromVal, Type* ToType)
     else if (FromType->getIntegerBitWidth() > ToType->getIntegerBitWidth())
       return CastInst::Create(Instruction::Trunc, FromVal, ToType, "cast", TheBlock);
   }
+  else if (FromType->isFloatingPointTy() && ToType->isFloatingPointTy()) {
+    if (ToType->getPrimitiveSizeInBits() > FromType->getPrimitiveSizeInBits())
+      return CastInst::Create(Instruction::FPExt, FromVal, ToType, "cast", TheBlock);
+    else if (FromType->getPrimitiveSizeInBits() > ToType->getPrimitiveSizeInBits())
+      return CastInst::Create(Instruction::FPTrunc, FromVal, ToType, "cast", TheBlock);
+  }
   return FromVal;
 }
 
@@ -109,9 +109,9 @@ template<
   typename T,
   typename std::enable_if_t<std::is_floating_point<T>::value>* = nullptr
   >
-llvm::Constant* llvmValue( llvm::LLVMContext & TheContext, llvm::Type* Ty, T Val )
+llvm::Constant* llvmValue( llvm::LLVMContext &, llvm::Type* Ty, T Val )
 {
-  return llvm::ConstantFP::get(TheContext, llvm::APFloat(Val));
+  return llvm::ConstantFP::get(Ty, Val);
 }
 
 template<typename T>